@@ -0,0 +1,138 @@
+#include "cc_epoch.h"
+#include "cc_thread_records.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+namespace crlib {
+
+namespace {
+
+constexpr uint64_t active_flag = 1;
+constexpr size_t collect_threshold = 64;
+
+struct Retired {
+	void* ptr;
+	void (*deleter)(void*);
+	uint64_t epoch;
+};
+
+struct EpochRecord {
+	// (epoch << 1) | active_flag while the thread is inside a guard, 0 otherwise
+	std::atomic<uint64_t> state{0};
+	std::atomic_bool in_use{true};
+	EpochRecord* next = nullptr;
+	size_t nesting = 0;
+	std::vector<Retired> retired;
+
+	void on_thread_exit();
+};
+
+struct EpochGlobals {
+	std::atomic<uint64_t> epoch{1};
+	internal::ThreadRecords<EpochRecord> records;
+	std::mutex orphans_mutex;
+	std::vector<Retired> orphans;
+};
+
+EpochGlobals& globals() {
+	return internal::leaked_globals<EpochGlobals>();
+}
+
+internal::ThreadRecords<EpochRecord>& records() {
+	return globals().records;
+}
+
+uint64_t try_advance() {
+	auto& g = globals();
+	auto epoch = g.epoch.load(std::memory_order_seq_cst);
+	for (auto r = g.records.head(); r != nullptr; r = r->next) {
+		auto s = r->state.load(std::memory_order_seq_cst);
+		if ((s & active_flag) != 0 && (s >> 1) != epoch) {
+			return epoch;
+		}
+	}
+
+	if (g.epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel)) {
+		return epoch + 1;
+	}
+	return epoch;
+}
+
+// Frees every node retired at least two epochs before 'epoch'
+void free_unreachable(std::vector<Retired>& list, uint64_t epoch) {
+	size_t kept = 0;
+	for (size_t i = 0; i < list.size(); i++) {
+		if (list[i].epoch + 2 <= epoch) {
+			list[i].deleter(list[i].ptr);
+		} else {
+			list[kept++] = list[i];
+		}
+	}
+	list.resize(kept);
+}
+
+void collect_record(EpochRecord* r) {
+	auto epoch = try_advance();
+	free_unreachable(r->retired, epoch);
+
+	auto& g = globals();
+	std::unique_lock<std::mutex> l(g.orphans_mutex, std::try_to_lock);
+	if (l.owns_lock() && !g.orphans.empty()) {
+		free_unreachable(g.orphans, epoch);
+	}
+}
+
+void EpochRecord::on_thread_exit() {
+	nesting = 0;
+	state.store(0, std::memory_order_release);
+	collect_record(this);
+	if (!retired.empty()) {
+		auto& g = globals();
+		std::lock_guard<std::mutex> l(g.orphans_mutex);
+		g.orphans.insert(g.orphans.end(), retired.begin(), retired.end());
+		retired.clear();
+	}
+}
+
+thread_local internal::ThreadRecord<EpochRecord, records> local_record;
+
+}
+
+CRLIB_API void Epoch::enter() {
+	auto r = local_record.get();
+	if (r->nesting++ == 0) {
+		auto epoch = globals().epoch.load(std::memory_order_relaxed);
+		r->state.store((epoch << 1) | active_flag, std::memory_order_relaxed);
+		// The announcement must be visible before any protected pointer is read
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+}
+
+CRLIB_API void Epoch::exit() {
+	auto r = local_record.record;
+	if (r == nullptr || r->nesting == 0) {
+		return;
+	}
+
+	if (--r->nesting == 0) {
+		r->state.store(0, std::memory_order_release);
+	}
+}
+
+CRLIB_API void Epoch::retire(void* ptr, void (*deleter)(void*)) {
+	auto r = local_record.get();
+	auto epoch = globals().epoch.load(std::memory_order_seq_cst);
+	r->retired.push_back({ptr, deleter, epoch});
+
+	if (r->retired.size() >= collect_threshold) {
+		collect_record(r);
+	}
+}
+
+CRLIB_API void Epoch::collect() {
+	collect_record(local_record.get());
+}
+
+}
@@ -0,0 +1,225 @@
+#include "cc_inspector.h"
+#include "cc_thread_records.h"
+#include <algorithm>
+#include <csignal>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace crlib {
+
+namespace {
+
+// Frames are spread over several lists, so that tasks created on different threads rarely share a mutex
+constexpr size_t shard_count = 16;
+
+struct Shard {
+	std::mutex mutex;
+	internal::InspectorFrame* first = nullptr;
+};
+
+struct InspectorGlobals {
+	Shard shards[shard_count];
+	std::atomic_bool signal_watcher{false};
+	std::atomic_bool dump_requested{false};
+};
+
+InspectorGlobals& globals() {
+	return internal::leaked_globals<InspectorGlobals>();
+}
+
+Shard& shard_for(const internal::InspectorFrame* frame) {
+	return globals().shards[(std::hash<const void*>()(frame) >> 4) % shard_count];
+}
+
+// Extracts A from the name of internal::awaiter_type_name<A>()
+std::string awaiter_type(const char* function_name) {
+	if (function_name == nullptr) {
+		return {};
+	}
+
+	std::string name(function_name);
+	auto gcc_start = name.find("A = ");
+	if (gcc_start != std::string::npos) {
+		auto end = name.find_first_of(";]", gcc_start);
+		return name.substr(gcc_start + 4, end == std::string::npos ? std::string::npos : end - gcc_start - 4);
+	}
+
+	auto msvc_start = name.find("awaiter_type_name<");
+	auto msvc_end = name.rfind(">(");
+	if (msvc_start != std::string::npos && msvc_end != std::string::npos && msvc_end > msvc_start) {
+		msvc_start += sizeof("awaiter_type_name<") - 1;
+		return name.substr(msvc_start, msvc_end - msvc_start);
+	}
+	return name;
+}
+
+const char* state_name(TaskState state) {
+	switch (state) {
+		case TaskState::Scheduled: return "Scheduled";
+		case TaskState::Running: return "Running";
+		case TaskState::Suspended: return "Suspended";
+	}
+	return "Unknown";
+}
+
+void write_task(std::ostream& out, const TaskSnapshot& task, size_t depth) {
+	std::string indent(depth * 4, ' ');
+	out << indent << "Task " << task.frame << " (lock " << task.lock << ") " << state_name(task.state) << " for "
+		<< std::fixed << std::setprecision(3) << std::chrono::duration<double, std::milli>(task.time_in_state).count() << "ms";
+	if (task.awaiting != nullptr) {
+		out << ", awaiting " << task.awaiting_type << " " << task.awaiting;
+	}
+	out << std::endl;
+
+	if (task.location.file_name() != nullptr && task.location.file_name()[0] != '\0') {
+		out << indent << "    created in " << task.location.function_name() << " at " << task.location.file_name() << ":"
+			<< task.location.line() << std::endl;
+	}
+}
+
+void signal_handler(int) {
+	globals().dump_requested.store(true, std::memory_order_relaxed);
+}
+
+}
+
+CRLIB_API internal::InspectorFrame::InspectorFrame(std::source_location location, const void* lock) : location(location), lock(lock),
+	frame(nullptr), state(TaskState::Scheduled), since(std::chrono::steady_clock::now().time_since_epoch().count()), awaiting_type(nullptr),
+	awaiting(nullptr) {
+	auto& shard = shard_for(this);
+	std::lock_guard guard(shard.mutex);
+	next = shard.first;
+	if (next != nullptr) {
+		next->previous = this;
+	}
+	shard.first = this;
+}
+
+CRLIB_API internal::InspectorFrame::~InspectorFrame() {
+	auto& shard = shard_for(this);
+	std::lock_guard guard(shard.mutex);
+	if (previous != nullptr) {
+		previous->next = next;
+	} else {
+		shard.first = next;
+	}
+	if (next != nullptr) {
+		next->previous = previous;
+	}
+}
+
+CRLIB_API std::vector<TaskSnapshot> Inspector::snapshot() {
+	std::vector<TaskSnapshot> tasks;
+	auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+
+	for (auto& shard : globals().shards) {
+		std::lock_guard guard(shard.mutex);
+		for (auto f = shard.first; f != nullptr; f = f->next) {
+			auto state = f->state.load(std::memory_order_acquire);
+			auto since = f->since.load(std::memory_order_relaxed);
+			tasks.push_back({
+				f->frame.load(std::memory_order_relaxed),
+				f->lock,
+				f->location,
+				state,
+				std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::duration(std::max<int64_t>(now - since, 0))),
+				awaiter_type(f->awaiting_type.load(std::memory_order_relaxed)),
+				f->awaiting.load(std::memory_order_relaxed),
+				std::nullopt
+			});
+		}
+	}
+
+	// A task awaiting another task is suspended on that task's lock
+	std::unordered_map<const void*, size_t> by_lock;
+	for (size_t i = 0; i < tasks.size(); i++) {
+		by_lock.emplace(tasks[i].lock, i);
+	}
+	for (size_t i = 0; i < tasks.size(); i++) {
+		if (tasks[i].state != TaskState::Suspended || tasks[i].awaiting == nullptr) {
+			continue;
+		}
+		auto awaited = by_lock.find(tasks[i].awaiting);
+		if (awaited != by_lock.end() && awaited->second != i && !tasks[awaited->second].awaited_by.has_value()) {
+			tasks[awaited->second].awaited_by = i;
+		}
+	}
+	return tasks;
+}
+
+CRLIB_API size_t Inspector::live_tasks() {
+	size_t count = 0;
+	for (auto& shard : globals().shards) {
+		std::lock_guard guard(shard.mutex);
+		for (auto f = shard.first; f != nullptr; f = f->next) {
+			count++;
+		}
+	}
+	return count;
+}
+
+CRLIB_API void Inspector::dump(std::ostream& out) {
+	auto tasks = snapshot();
+	auto flags = out.flags();
+	auto precision = out.precision();
+	out << "[INSPECTOR] " << tasks.size() << " live tasks" << std::endl;
+
+	// Async stacks start from the tasks that are not waiting for another live task
+	std::vector<bool> awaits_task(tasks.size(), false);
+	for (auto& t : tasks) {
+		if (t.awaited_by.has_value()) {
+			awaits_task[t.awaited_by.value()] = true;
+		}
+	}
+
+	std::vector<bool> printed(tasks.size(), false);
+	for (size_t i = 0; i < tasks.size(); i++) {
+		if (awaits_task[i]) {
+			continue;
+		}
+
+		size_t depth = 0;
+		for (std::optional<size_t> t = i; t.has_value() && !printed[t.value()]; t = tasks[t.value()].awaited_by) {
+			write_task(out, tasks[t.value()], depth++);
+			printed[t.value()] = true;
+		}
+	}
+
+	// Only tasks awaiting each other in a cycle are left
+	for (size_t i = 0; i < tasks.size(); i++) {
+		if (!printed[i]) {
+			out << "[INSPECTOR] Await cycle:" << std::endl;
+			size_t depth = 0;
+			for (std::optional<size_t> t = i; t.has_value() && !printed[t.value()]; t = tasks[t.value()].awaited_by) {
+				write_task(out, tasks[t.value()], depth++);
+				printed[t.value()] = true;
+			}
+		}
+	}
+	out.flags(flags);
+	out.precision(precision);
+	out.flush();
+}
+
+CRLIB_API void Inspector::dump_on_signal(int signal) {
+	auto& g = globals();
+	std::signal(signal, signal_handler);
+
+	// Only setting a flag is safe in a signal handler: the dump itself happens on a watcher thread
+	if (!g.signal_watcher.exchange(true)) {
+		std::thread([&g]() {
+			while (true) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				if (g.dump_requested.exchange(false, std::memory_order_relaxed)) {
+					dump(std::cerr);
+				}
+			}
+		}).detach();
+	}
+}
+
+}
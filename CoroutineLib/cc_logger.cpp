@@ -0,0 +1,199 @@
+#include "cc_logger.h"
+#include "cc_thread_records.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace crlib {
+
+namespace {
+
+constexpr uint64_t ring_size = CRLIB_LOG_BUFFER_SIZE;
+
+// Single producer (the owning thread), single consumer (whoever holds the drain mutex)
+struct LogRing {
+	std::atomic<uint64_t> head{0};
+	std::atomic<uint64_t> tail{0};
+	std::atomic_bool in_use{true};
+	uint32_t id = 0;
+	LogRing* next = nullptr;
+	internal::LogRecord records[ring_size];
+
+	// Rings of exited threads are only reused once drained, so their records keep their thread id
+	bool reusable() const {
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+};
+
+struct LoggerGlobals {
+	internal::ThreadRecords<LogRing> rings;
+	std::atomic<uint64_t> dropped{0};
+
+	std::mutex drain_mutex;
+	Logger::Sink sink;
+	std::vector<std::pair<uint32_t, internal::LogRecord>> pending;
+
+	std::mutex thread_mutex;
+	std::condition_variable thread_variable;
+	std::thread* thread = nullptr;
+	bool stopping = false;
+};
+
+LoggerGlobals& globals() {
+	return internal::leaked_globals<LoggerGlobals>();
+}
+
+internal::ThreadRecords<LogRing>& rings() {
+	return globals().rings;
+}
+
+thread_local internal::ThreadRecord<LogRing, rings> local_ring;
+
+void format_arg(std::ostream& out, internal::LogArgType type, uint64_t word) {
+	switch (type) {
+		case internal::LogArgType::Int:
+			out << static_cast<int64_t>(word);
+			break;
+		case internal::LogArgType::UInt:
+			out << word;
+			break;
+		case internal::LogArgType::Bool:
+			out << (word != 0 ? "true" : "false");
+			break;
+		case internal::LogArgType::Char:
+			out << static_cast<char>(word);
+			break;
+		case internal::LogArgType::Double:
+			out << std::bit_cast<double>(word);
+			break;
+		case internal::LogArgType::String: {
+			auto str = reinterpret_cast<const char*>(static_cast<uintptr_t>(word));
+			out << (str != nullptr ? str : "(null)");
+			break;
+		}
+		case internal::LogArgType::Pointer:
+			out << "0x" << std::hex << word << std::dec;
+			break;
+	}
+}
+
+std::string format_record(uint32_t thread, const internal::LogRecord& record) {
+	std::ostringstream out;
+	out << "[LOG][" << thread << "]";
+
+	const char* f = record.format->format;
+	size_t arg = 0;
+	while (*f != '\0') {
+		if (f[0] == '{' && f[1] == '}') {
+			if (arg < record.count) {
+				format_arg(out, record.types[arg], record.args[arg]);
+				arg++;
+			} else {
+				out << "{}";
+			}
+			f += 2;
+		} else {
+			out << *f++;
+		}
+	}
+	return out.str();
+}
+
+void drain_thread(std::chrono::milliseconds interval) {
+	auto& g = globals();
+	std::unique_lock lock(g.thread_mutex);
+	while (!g.stopping) {
+		lock.unlock();
+		Logger::flush();
+		lock.lock();
+		g.thread_variable.wait_for(lock, interval, [&g]() { return g.stopping; });
+	}
+}
+
+}
+
+CRLIB_API void Logger::write(const internal::LogRecord& record) {
+	auto r = local_ring.get();
+	auto head = r->head.load(std::memory_order_relaxed);
+	if (head - r->tail.load(std::memory_order_acquire) >= ring_size) {
+		globals().dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	std::memcpy(&r->records[head % ring_size], &record, sizeof(record));
+	r->head.store(head + 1, std::memory_order_release);
+}
+
+CRLIB_API void Logger::set_sink(Sink sink) {
+	auto& g = globals();
+	std::lock_guard lock(g.drain_mutex);
+	g.sink = std::move(sink);
+}
+
+CRLIB_API void Logger::flush() {
+	auto& g = globals();
+	std::lock_guard lock(g.drain_mutex);
+
+	g.pending.clear();
+	for (auto r = g.rings.head(); r != nullptr; r = r->next) {
+		auto tail = r->tail.load(std::memory_order_relaxed);
+		auto head = r->head.load(std::memory_order_acquire);
+		for (auto i = tail; i < head; i++) {
+			g.pending.emplace_back(r->id, r->records[i % ring_size]);
+		}
+		r->tail.store(head, std::memory_order_release);
+	}
+
+	std::stable_sort(g.pending.begin(), g.pending.end(), [](const auto& a, const auto& b) {
+		return a.second.timestamp < b.second.timestamp;
+	});
+
+	for (auto& p : g.pending) {
+		auto line = format_record(p.first, p.second);
+		if (g.sink) {
+			g.sink(line);
+		} else {
+			std::cout << line << std::endl;
+		}
+	}
+}
+
+CRLIB_API void Logger::start(std::chrono::milliseconds interval) {
+	auto& g = globals();
+	std::lock_guard lock(g.thread_mutex);
+	if (g.thread != nullptr) {
+		return;
+	}
+	g.stopping = false;
+	g.thread = new std::thread(drain_thread, interval);
+}
+
+CRLIB_API void Logger::stop() {
+	auto& g = globals();
+	std::thread* t;
+	{
+		std::lock_guard lock(g.thread_mutex);
+		t = g.thread;
+		g.thread = nullptr;
+		g.stopping = true;
+	}
+	g.thread_variable.notify_all();
+
+	if (t != nullptr) {
+		t->join();
+		delete t;
+	}
+	flush();
+}
+
+CRLIB_API uint64_t Logger::dropped() {
+	return globals().dropped.load(std::memory_order_relaxed);
+}
+
+}
@@ -1,21 +1,72 @@
 #include "cc_task_scheduler.h"
+#include "cc_thread_records.h"
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <system_error>
+#endif
 
 namespace crlib {
 
 CRLIB_API std::shared_ptr<BaseTaskScheduler> BaseTaskScheduler::default_task_scheduler = nullptr;
-thread_local std::shared_ptr<BaseTaskScheduler> BaseTaskScheduler::current_scheduler = nullptr;
+constinit thread_local BaseTaskScheduler* BaseTaskScheduler::current_scheduler = nullptr;
+
+namespace {
+thread_local unsigned inline_depth = 0;
+// Innermost coroutine whose awaiter is publishing its continuation on this thread
+thread_local internal::SuspendScope* suspending = nullptr;
+// Whether an InlineScheduler resume is on this thread's stack, and the resumes it queued past the maximum depth
+thread_local bool inline_running = false;
+thread_local std::deque<std::coroutine_handle<>> inline_overflow;
+}
 
 CRLIB_API BaseTaskScheduler::BaseTaskScheduler() = default;
 
-CRLIB_API void BaseTaskScheduler::Schedule(std::coroutine_handle<> handle) {
-    if (current_scheduler != nullptr) {
-        current_scheduler->OnTaskSubmitted(handle);
-    } else {
+#ifdef _WIN32
+CRLIB_API BaseTaskScheduler* BaseTaskScheduler::Current() {
+    return current_scheduler;
+}
+#endif
+
+CRLIB_API void BaseTaskScheduler::SetCurrent(BaseTaskScheduler* scheduler) {
+    current_scheduler = scheduler;
+}
+
+CRLIB_API std::atomic_bool BaseTaskScheduler::default_ready = false;
+
+CRLIB_API void BaseTaskScheduler::InitDefault() {
+    static std::once_flag once;
+    std::call_once(once, []() {
         if (default_task_scheduler == nullptr) {
             default_task_scheduler = std::make_shared<ThreadPoolTaskScheduler>();
+            // Kept alive by a leaked reference: destroying it with the other statics would join its workers,
+            // which may be blocked or still using those statics. The process exit ends them.
+            internal::leaked_globals<std::shared_ptr<BaseTaskScheduler>>() = default_task_scheduler;
         }
-        default_task_scheduler->OnTaskSubmitted(handle);
+        default_ready.store(true, std::memory_order_release);
+    });
+}
+
+CRLIB_API void BaseTaskScheduler::ResumeOn(BaseTaskScheduler* home, std::coroutine_handle<> handle, bool allow_inline) {
+    if (internal::SuspendScope::defer(handle)) {
+        return;
     }
+
+    if (allow_inline && home == current_scheduler && inline_depth < CRLIB_MAX_INLINE_RESUME_DEPTH) {
+        inline_depth++;
+        handle.resume();
+        inline_depth--;
+        return;
+    }
+
+    home->Submit(handle);
+}
+
+CRLIB_API void BaseTaskScheduler::set_observer([[maybe_unused]] std::shared_ptr<SchedulerObserver> o, [[maybe_unused]] bool account_cpu_time) {
+#ifdef CRLIB_OBSERVERS
+    observer.set(std::move(o), account_cpu_time);
+#endif
 }
 
 CRLIB_API ThreadPoolTaskScheduler::ThreadPoolTaskScheduler() : ThreadPoolTaskScheduler(CRLIB_DEFAULT_THREAD_POOL_THREADS) {
@@ -23,11 +74,178 @@ CRLIB_API ThreadPoolTaskScheduler::ThreadPoolTaskScheduler() : ThreadPoolTaskSch
 }
 
 CRLIB_API ThreadPoolTaskScheduler::ThreadPoolTaskScheduler(size_t thread_amount) {
-    thread_pool = ThreadPool::build(thread_amount);
+    thread_pool = ThreadPool::build(thread_amount, [this]() {
+        current_scheduler = this;
+    });
+    pool = thread_pool.get();
+}
+
+CRLIB_API ThreadPoolTaskScheduler::~ThreadPoolTaskScheduler() {
+    // The workers point at this scheduler
+    thread_pool->stop();
 }
 
 CRLIB_API void ThreadPoolTaskScheduler::OnTaskSubmitted(std::coroutine_handle<> handle) {
     thread_pool->submit(handle);
 }
 
+CRLIB_API void ThreadPoolTaskScheduler::set_observer(std::shared_ptr<SchedulerObserver> o, bool account_cpu_time) {
+    thread_pool->set_observer(std::move(o), account_cpu_time);
+}
+
+CRLIB_API internal::SuspendScope::SuspendScope(std::coroutine_handle<> h) : handle(h.address()), previous(suspending), resumed(false) {
+    suspending = this;
+}
+
+CRLIB_API internal::SuspendScope::~SuspendScope() {
+    suspending = previous;
+}
+
+CRLIB_API bool internal::SuspendScope::defer(std::coroutine_handle<> h) {
+    for (auto scope = suspending; scope != nullptr; scope = scope->previous) {
+        if (scope->handle == h.address()) {
+            scope->resumed = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+CRLIB_API EventLoopScheduler::EventLoopScheduler() : previous_scheduler(current_scheduler), sleeping(false), stopping(false) {
+#ifdef __linux__
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "eventfd");
+    }
+#else
+    woken = false;
+#endif
+    current_scheduler = this;
+}
+
+CRLIB_API EventLoopScheduler::~EventLoopScheduler() {
+    if (current_scheduler == this) {
+        current_scheduler = previous_scheduler;
+    }
+#ifdef __linux__
+    close(wake_fd);
+#endif
+}
+
+CRLIB_API void EventLoopScheduler::OnTaskSubmitted(std::coroutine_handle<> handle) {
+    if (current_scheduler == this) {
+        local_tasks.push_back(handle);
+        return;
+    }
+
+    inbox.push(handle);
+    // Pairs with the fence in sleep(): either the loop sees the handle, or this sees the loop sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed)) {
+        wake();
+    }
+}
+
+CRLIB_API size_t EventLoopScheduler::poll() {
+    for (auto h = inbox.pull(); h.has_value(); h = inbox.pull()) {
+        local_tasks.push_back(h.value());
+    }
+
+    // Coroutines submitted while these run wait for the next poll, so that the inbox is not starved
+    size_t ready = local_tasks.size();
+    size_t resumed = 0;
+    while (resumed < ready && !stopping.load(std::memory_order_relaxed)) {
+        auto h = local_tasks.front();
+        local_tasks.pop_front();
+#ifdef CRLIB_OBSERVERS
+        observer.resume(h);
+#else
+        h.resume();
+#endif
+        resumed++;
+    }
+    return resumed;
+}
+
+CRLIB_API void EventLoopScheduler::run() {
+    while (!stopping.load(std::memory_order_relaxed)) {
+        if (poll() == 0 && local_tasks.empty()) {
+            sleep();
+        }
+    }
+    stopping.store(false, std::memory_order_relaxed);
+}
+
+CRLIB_API void EventLoopScheduler::stop() {
+    stopping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (current_scheduler != this && sleeping.load(std::memory_order_relaxed)) {
+        wake();
+    }
+}
+
+void EventLoopScheduler::sleep() {
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    auto h = inbox.pull();
+    if (h.has_value()) {
+        local_tasks.push_back(h.value());
+    } else if (!stopping.load(std::memory_order_relaxed)) {
+        CC_OBSERVE(observer, on_park());
+#ifdef __linux__
+        uint64_t count;
+        while (read(wake_fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+
+        }
+#else
+        std::unique_lock lock(wake_mutex);
+        wake_variable.wait(lock, [this]() { return woken; });
+        woken = false;
+#endif
+    }
+    sleeping.store(false, std::memory_order_relaxed);
+}
+
+void EventLoopScheduler::wake() {
+#ifdef __linux__
+    uint64_t one = 1;
+    while (write(wake_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+
+    }
+#else
+    std::lock_guard lock(wake_mutex);
+    woken = true;
+    wake_variable.notify_one();
+#endif
+}
+
+CRLIB_API void InlineScheduler::Schedule(std::coroutine_handle<> handle) {
+    if (internal::SuspendScope::defer(handle)) {
+        return;
+    }
+
+    if (inline_running && inline_depth >= CRLIB_MAX_INLINE_RESUME_DEPTH) {
+        inline_overflow.push_back(handle);
+        return;
+    }
+
+    bool outermost = !inline_running;
+    inline_running = true;
+    inline_depth++;
+    handle.resume();
+    inline_depth--;
+
+    if (outermost) {
+        while (!inline_overflow.empty()) {
+            auto h = inline_overflow.front();
+            inline_overflow.pop_front();
+            inline_depth++;
+            h.resume();
+            inline_depth--;
+        }
+        inline_running = false;
+    }
+}
+
 }
\ No newline at end of file
@@ -1,11 +1,22 @@
 #include "cc_thread_pool.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
 
 
 namespace crlib {
 
-thread_local std::shared_ptr<ThreadPool_Thread> ThreadPool::local_thread = nullptr;
+constinit thread_local ThreadPool_Thread* ThreadPool::local_thread = nullptr;
 
-CRLIB_API ThreadPool::ThreadPool() : running(true) {
+#ifdef _WIN32
+CRLIB_API ThreadPool_Thread* ThreadPool::local() {
+	return local_thread;
+}
+#endif
+
+CRLIB_API ThreadPool::ThreadPool() : running(true), delay_sampling(CRLIB_SCHEDULING_DELAY_SAMPLING) {
 
 }
 
@@ -13,9 +24,10 @@ CRLIB_API ThreadPool::~ThreadPool() {
 	stop();
 }
 
-CRLIB_API std::shared_ptr<ThreadPool> ThreadPool::build(size_t thread_count) {
+CRLIB_API std::shared_ptr<ThreadPool> ThreadPool::build(size_t thread_count, std::function<void()> thread_init) {
 	std::shared_ptr<ThreadPool> self_ptr = std::shared_ptr<ThreadPool>(new ThreadPool());
 	self_ptr->self_ptr = self_ptr;
+	self_ptr->thread_init = std::move(thread_init);
 
 	for (size_t i = 0; i < thread_count; ++i) {
 		self_ptr->threads.push_back(std::shared_ptr<ThreadPool_Thread>(new ThreadPool_Thread(self_ptr)));
@@ -29,23 +41,8 @@ CRLIB_API std::shared_ptr<ThreadPool> ThreadPool::build(size_t thread_count) {
 	return self_ptr;
 }
 
-CRLIB_API void ThreadPool::submit(std::coroutine_handle<> h) {
-	if (local_thread != nullptr && local_thread->thread_pool.get() == this) {
-		if (local_thread->local_tasks->push(h)) {
-			return;
-		}
-	}
-
-	global_tasks_queue.push(h);
-
-	{
-		std::lock_guard lock(task_added_mutex);
-		task_added_variable.notify_all();
-	}
-}
-
-CRLIB_API std::optional<std::coroutine_handle<>> ThreadPool::get_work() {
-	std::optional<std::coroutine_handle<>> h;
+CRLIB_API std::optional<ScheduledHandle> ThreadPool::get_work() {
+	std::optional<ScheduledHandle> h;
 	do {
 		h = global_tasks_queue.pull();
 
@@ -56,6 +53,8 @@ CRLIB_API std::optional<std::coroutine_handle<>> ThreadPool::get_work() {
 		for (auto stuff : queues) {
 			h = stuff.second->pull();
 			if (h.has_value()) {
+				CC_TRACE(Steal, h->handle.address());
+				CC_OBSERVE(observer, on_steal(h->handle));
 				return h;
 			}
 		}
@@ -63,7 +62,10 @@ CRLIB_API std::optional<std::coroutine_handle<>> ThreadPool::get_work() {
 		if (!h.has_value())
 		{
 			auto lock = std::unique_lock<std::mutex>(task_added_mutex);
+			CC_TRACE(Park, nullptr);
+			CC_OBSERVE(observer, on_park());
 			task_added_variable.wait_for(lock, std::chrono::milliseconds(500));
+			CC_TRACE(Unpark, nullptr);
 		}
 		else {
 			return h;
@@ -75,10 +77,20 @@ CRLIB_API std::optional<std::coroutine_handle<>> ThreadPool::get_work() {
 }
 
 CRLIB_API void ThreadPool::stop() {
-	running = false;
+	{
+		// Parked workers would otherwise only notice after their wait times out
+		std::lock_guard lock(task_added_mutex);
+		running = false;
+		task_added_variable.notify_all();
+	}
 
 	for (auto& t : threads) {
-		t->join();
+		// The last reference to the pool, or to its scheduler, may be dropped by one of its own workers
+		if (t->self->get_id() == std::this_thread::get_id()) {
+			t->self->detach();
+		} else {
+			t->join();
+		}
 	}
 
 	threads.clear();
@@ -88,4 +100,45 @@ CRLIB_API void ThreadPool::register_queue(std::thread::id id, QueuePtr queue) {
 	queues.set(id, queue);
 }
 
+CRLIB_API void ThreadPool::set_scheduling_delay_sampling(uint32_t sampling) {
+	delay_sampling.store(sampling, std::memory_order_relaxed);
+}
+
+CRLIB_API void ThreadPool::merge_scheduling_delay(LatencyHistogram& into) {
+	for (auto& t : threads) {
+		into.merge(t->scheduling_delay);
+	}
+}
+
+CRLIB_API void ThreadPool::reset_scheduling_delay() {
+	for (auto& t : threads) {
+		t->scheduling_delay.reset();
+	}
+}
+
+CRLIB_API void ThreadPool::set_observer([[maybe_unused]] std::shared_ptr<SchedulerObserver> o, [[maybe_unused]] bool account_cpu_time) {
+#ifdef CRLIB_OBSERVERS
+	observer.set(std::move(o), account_cpu_time);
+#endif
+}
+
+CRLIB_API std::chrono::nanoseconds internal::thread_cpu_time() {
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+		return std::chrono::nanoseconds(0);
+	}
+	auto ticks = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32 | kernel.dwLowDateTime)
+		+ (static_cast<uint64_t>(user.dwHighDateTime) << 32 | user.dwLowDateTime);
+	// 100ns units
+	return std::chrono::nanoseconds(ticks * 100);
+#else
+	timespec ts {};
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+		return std::chrono::nanoseconds(0);
+	}
+	return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+#endif
+}
+
 }
\ No newline at end of file
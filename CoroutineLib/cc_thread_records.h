@@ -0,0 +1,89 @@
+#ifndef COROUTINELIB_CC_THREAD_RECORDS_H
+#define COROUTINELIB_CC_THREAD_RECORDS_H
+
+#include <atomic>
+#include <cstdint>
+
+// Shared by the modules that keep per-thread state (epoch, trace, logger, inspector), not part of the public headers
+namespace crlib::internal {
+	/*
+	 * The globals of a module, created on first use and leaked on purpose: thread pool workers
+	 * may still use them while static destructors run.
+	 */
+	template<typename T>
+	T& leaked_globals() {
+		static auto* g = new T();
+		return *g;
+	}
+
+	/*
+	 * Lock-free list of per-thread records. A thread claims a record on first use and releases it when it exits,
+	 * for the next thread to reuse: records are never freed, so the list can be walked at any time.
+	 * Record needs an std::atomic_bool in_use (initially true) and a Record* next. If it has a uint32_t id, it is numbered,
+	 * and if it has bool reusable() const, records that are not reusable yet are skipped.
+	 */
+	template<typename Record>
+	struct ThreadRecords {
+		std::atomic<Record*> first{nullptr};
+		std::atomic<uint32_t> count{0};
+
+		Record* acquire() {
+			for (auto r = first.load(std::memory_order_acquire); r != nullptr; r = r->next) {
+				bool expected = false;
+				if (r->in_use.load(std::memory_order_acquire)) {
+					continue;
+				}
+				if constexpr (requires { r->reusable(); }) {
+					if (!r->reusable()) {
+						continue;
+					}
+				}
+				if (r->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+					return r;
+				}
+			}
+
+			auto r = new Record();
+			if constexpr (requires { r->id; }) {
+				r->id = count.fetch_add(1, std::memory_order_relaxed);
+			}
+			auto head = first.load(std::memory_order_relaxed);
+			do {
+				r->next = head;
+			} while (!first.compare_exchange_weak(head, r, std::memory_order_release, std::memory_order_relaxed));
+			return r;
+		}
+
+		Record* head() const {
+			return first.load(std::memory_order_acquire);
+		}
+	};
+
+	/*
+	 * The calling thread's record from the registry returned by Registry(), meant to be thread_local.
+	 * When the thread exits, the record's on_thread_exit() runs, if it has one, before it is released.
+	 */
+	template<typename Record, ThreadRecords<Record>& (*Registry)()>
+	struct ThreadRecord {
+		Record* record = nullptr;
+
+		Record* get() {
+			if (record == nullptr) {
+				record = Registry().acquire();
+			}
+			return record;
+		}
+
+		~ThreadRecord() {
+			if (record == nullptr) {
+				return;
+			}
+			if constexpr (requires { record->on_thread_exit(); }) {
+				record->on_thread_exit();
+			}
+			record->in_use.store(false, std::memory_order_release);
+		}
+	};
+}
+
+#endif //COROUTINELIB_CC_THREAD_RECORDS_H
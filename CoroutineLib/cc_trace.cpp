@@ -0,0 +1,195 @@
+#include "cc_trace.h"
+#include "cc_thread_records.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+namespace crlib {
+
+namespace {
+
+constexpr uint64_t buffer_size = CRLIB_TRACE_BUFFER_SIZE;
+
+// Fields are atomic so that dumping while other threads record is not a data race
+struct TraceSlot {
+	std::atomic<uint64_t> timestamp{0};
+	std::atomic<uint64_t> task{0};
+	std::atomic<uint64_t> detail{0};
+	std::atomic<uint8_t> event{0};
+};
+
+struct TraceBuffer {
+	// Events are published by moving head, after claiming their slot by moving claimed
+	std::atomic<uint64_t> head{0};
+	std::atomic<uint64_t> claimed{0};
+	// Events before this index were cleared
+	std::atomic<uint64_t> start{0};
+	std::atomic_bool in_use{true};
+	uint32_t id = 0;
+	TraceBuffer* next = nullptr;
+	TraceSlot slots[buffer_size];
+};
+
+struct TraceGlobals {
+	std::atomic_bool enabled{true};
+	internal::ThreadRecords<TraceBuffer> buffers;
+	std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+};
+
+TraceGlobals& globals() {
+	return internal::leaked_globals<TraceGlobals>();
+}
+
+internal::ThreadRecords<TraceBuffer>& buffers() {
+	return globals().buffers;
+}
+
+thread_local internal::ThreadRecord<TraceBuffer, buffers> local_buffer;
+
+const char* event_name(TraceEvent event) {
+	switch (event) {
+		case TraceEvent::Create: return "Create";
+		case TraceEvent::Schedule: return "Schedule";
+		case TraceEvent::Resume: return "Resume";
+		case TraceEvent::Suspend: return "Suspend";
+		case TraceEvent::Await: return "Await";
+		case TraceEvent::Complete: return "Complete";
+		case TraceEvent::Steal: return "Steal";
+		case TraceEvent::Park: return "Park";
+		case TraceEvent::Unpark: return "Unpark";
+	}
+	return "Unknown";
+}
+
+void write_hex(std::ostream& out, uint64_t value) {
+	out << "\"0x" << std::hex << value << std::dec << "\"";
+}
+
+}
+
+CRLIB_API void Trace::record(TraceEvent event, const void* task, const void* detail) {
+	auto& g = globals();
+	if (!g.enabled.load(std::memory_order_relaxed)) {
+		return;
+	}
+
+	auto b = local_buffer.get();
+	auto index = b->head.load(std::memory_order_relaxed);
+	auto& slot = b->slots[index % buffer_size];
+	b->claimed.store(index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	auto now = std::chrono::steady_clock::now() - g.origin;
+	slot.timestamp.store(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()), std::memory_order_relaxed);
+	slot.task.store(reinterpret_cast<uintptr_t>(task), std::memory_order_relaxed);
+	slot.detail.store(reinterpret_cast<uintptr_t>(detail), std::memory_order_relaxed);
+	slot.event.store(static_cast<uint8_t>(event), std::memory_order_relaxed);
+	b->head.store(index + 1, std::memory_order_release);
+}
+
+CRLIB_API void Trace::set_enabled(bool enabled) {
+	globals().enabled.store(enabled, std::memory_order_relaxed);
+}
+
+CRLIB_API bool Trace::is_enabled() {
+	return globals().enabled.load(std::memory_order_relaxed);
+}
+
+CRLIB_API void Trace::clear() {
+	for (auto b = globals().buffers.head(); b != nullptr; b = b->next) {
+		b->start.store(b->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+	}
+}
+
+CRLIB_API void Trace::write_chrome_json(std::ostream& out) {
+	struct Entry {
+		uint64_t timestamp;
+		uint64_t task;
+		uint64_t detail;
+		TraceEvent event;
+	};
+
+	out << "{\"traceEvents\":[";
+	bool first = true;
+	auto separator = [&out, &first]() {
+		if (!first) {
+			out << ",";
+		}
+		first = false;
+	};
+
+	std::vector<Entry> entries;
+	for (auto b = globals().buffers.head(); b != nullptr; b = b->next) {
+		auto head = b->head.load(std::memory_order_acquire);
+		auto begin = std::max(b->start.load(std::memory_order_relaxed), head > buffer_size ? head - buffer_size : 0);
+
+		entries.clear();
+		for (auto i = begin; i < head; i++) {
+			auto& slot = b->slots[i % buffer_size];
+			entries.push_back({
+				slot.timestamp.load(std::memory_order_relaxed),
+				slot.task.load(std::memory_order_relaxed),
+				slot.detail.load(std::memory_order_relaxed),
+				static_cast<TraceEvent>(slot.event.load(std::memory_order_relaxed))
+			});
+		}
+
+		// The owner may have overwritten the oldest slots while they were copied
+		std::atomic_thread_fence(std::memory_order_acquire);
+		auto claimed = b->claimed.load(std::memory_order_relaxed);
+		auto valid_from = claimed > buffer_size ? claimed - buffer_size : 0;
+		auto skip = valid_from > begin ? std::min<size_t>(static_cast<size_t>(valid_from - begin), entries.size()) : 0;
+
+		separator();
+		out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << b->id << ",\"args\":{\"name\":\"Thread " << b->id << "\"}}";
+
+		size_t depth = 0;
+		for (size_t i = skip; i < entries.size(); i++) {
+			auto& e = entries[i];
+
+			// Resume/Suspend and Park/Unpark pairs become slices on the thread's track, everything else is an instant event
+			const char* name = event_name(e.event);
+			char phase = 'i';
+			if (e.event == TraceEvent::Resume || e.event == TraceEvent::Park) {
+				name = e.event == TraceEvent::Resume ? "Running" : "Parked";
+				phase = 'B';
+				depth++;
+			} else if (e.event == TraceEvent::Suspend || e.event == TraceEvent::Unpark) {
+				if (depth == 0) {
+					// Its beginning was overwritten
+					continue;
+				}
+				phase = 'E';
+				depth--;
+			}
+
+			separator();
+			out << "{\"name\":\"" << name << "\",\"cat\":\"task\",\"ph\":\"" << phase << "\",\"pid\":1,\"tid\":" << b->id
+				<< ",\"ts\":" << e.timestamp / 1000 << "." << std::setw(3) << std::setfill('0') << e.timestamp % 1000 << std::setfill(' ');
+			if (phase == 'i') {
+				out << ",\"s\":\"t\"";
+			}
+			out << ",\"args\":{\"task\":";
+			write_hex(out, e.task);
+			if (e.detail != 0) {
+				out << ",\"awaiting\":";
+				write_hex(out, e.detail);
+			}
+			out << "}}";
+		}
+	}
+	out << "],\"displayTimeUnit\":\"ns\"}";
+}
+
+CRLIB_API bool Trace::write_chrome_json(const std::string& path) {
+	std::ofstream out(path);
+	if (!out) {
+		return false;
+	}
+	write_chrome_json(out);
+	return static_cast<bool>(out);
+}
+
+}
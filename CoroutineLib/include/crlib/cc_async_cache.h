@@ -0,0 +1,310 @@
+#ifndef COROUTINELIB_CC_ASYNC_CACHE_H
+#define COROUTINELIB_CC_ASYNC_CACHE_H
+
+#include <memory>
+#include <optional>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <type_traits>
+#include <concepts>
+#include <algorithm>
+#include <utility>
+#include "cc_dictionary.h"
+
+namespace crlib {
+	/*
+	 * Bounded cache, split in shards so that writers of different keys rarely contend.
+	 * Lookups read the entry in place in the shard's ConcurrentDictionary and never lock: a hit only sets the entry's reference bit.
+	 * Evictions follow the CLOCK policy: when a shard is over capacity, its hand sweeps the entries, sparing
+	 * (and clearing) those referenced since the last sweep, and evicting the first that was not.
+	 * Capacity is counted in entries, or in the unit returned by the weigher when one is given, and split exactly between the shards.
+	 * Entries may have a time to live: expired entries are dropped when they are looked up or swept by the hand.
+	 */
+	template<typename K, typename V>
+	class AsyncCache {
+	public:
+		using clock = std::chrono::steady_clock;
+		using Weigher = std::function<size_t(const K&, const V&)>;
+
+	protected:
+		struct Entry {
+			const K key;
+			const V value;
+			const clock::time_point expires;
+			const size_t weight;
+			std::atomic_bool referenced;
+			// Position in the shard's clock ring, only accessed with the shard mutex held
+			size_t slot;
+
+			Entry(const K& key, const V& value, clock::time_point expires, size_t weight) :
+					key(key), value(value), expires(expires), weight(weight), referenced(false), slot(0) {
+
+			}
+
+			bool expired(clock::time_point now) const {
+				return now >= expires;
+			}
+		};
+
+		using EntryPtr = std::shared_ptr<Entry>;
+
+		struct Shard {
+			ConcurrentDictionary<K, EntryPtr> entries;
+			std::mutex mutex;
+			std::vector<EntryPtr> ring;
+			std::vector<size_t> free_slots;
+			size_t hand = 0;
+			size_t weight = 0;
+			size_t count = 0;
+			const size_t capacity;
+			// Loads of get_or_load() still running, only accessed with the mutex held. set() and erase() cancel the key's
+			// flight, which then hands its result to its awaiters without caching it
+			internal::Flights<K, V> flights;
+
+			explicit Shard(size_t capacity) : entries(64, std::max<size_t>(internal::next_power_of_two(capacity), 64)), capacity(capacity) {
+
+			}
+
+			// Must hold the mutex
+			void unlink(const EntryPtr& e) {
+				ring[e->slot] = nullptr;
+				free_slots.push_back(e->slot);
+				weight -= e->weight;
+				count--;
+			}
+
+			// Must hold the mutex
+			void link(const EntryPtr& e) {
+				if (!free_slots.empty()) {
+					e->slot = free_slots.back();
+					free_slots.pop_back();
+					ring[e->slot] = e;
+				} else {
+					e->slot = ring.size();
+					ring.push_back(e);
+				}
+				weight += e->weight;
+				count++;
+			}
+
+			// Must hold the mutex
+			void evict_one(clock::time_point now) {
+				// Two turns at most: the first one clears every reference bit
+				for (size_t visited = 0; visited < ring.size() * 2 + 1; visited++) {
+					if (hand >= ring.size()) {
+						hand = 0;
+					}
+					auto& e = ring[hand];
+					hand++;
+
+					if (e == nullptr) {
+						continue;
+					}
+					if (!e->expired(now) && e->referenced.exchange(false, std::memory_order_relaxed)) {
+						continue;
+					}
+
+					auto victim = e;
+					entries.erase(victim->key);
+					unlink(victim);
+					return;
+				}
+			}
+		};
+
+		std::vector<std::unique_ptr<Shard>> shards;
+		const clock::duration default_ttl;
+		Weigher weigher;
+
+		Shard& shard_for(const K& key) {
+			// Fibonacci hashing: uses other bits of the hash than the shard dictionaries do
+			auto h = static_cast<uint64_t>(std::hash<K>()(key)) * 0x9E3779B97F4A7C15ULL;
+			return *shards[static_cast<size_t>(h >> 32) & (shards.size() - 1)];
+		}
+
+		// A power of two, and no more shards than capacity units, so that every shard holds at least one
+		static size_t shards_for(size_t capacity, size_t shard_count) {
+			auto n = internal::next_power_of_two(std::max<size_t>(shard_count, 1));
+			while (n > 1 && n > capacity) {
+				n /= 2;
+			}
+			return n;
+		}
+
+		clock::time_point expiry(clock::duration ttl) const {
+			if (ttl <= clock::duration::zero()) {
+				return clock::time_point::max();
+			}
+			return clock::now() + ttl;
+		}
+
+		// Must hold the shard mutex
+		void insert(Shard& shard, const EntryPtr& e) {
+			auto old = shard.entries.get(e->key);
+			if (old.has_value()) {
+				shard.unlink(old.value());
+			}
+
+			auto now = clock::now();
+			while (shard.count > 0 && shard.weight + e->weight > shard.capacity) {
+				shard.evict_one(now);
+			}
+
+			shard.link(e);
+			shard.entries.set(e->key, e);
+		}
+
+		EntryPtr make_entry(const K& key, const V& value, clock::duration ttl) const {
+			return std::make_shared<Entry>(key, value, expiry(ttl), weigher ? weigher(key, value) : 1);
+		}
+
+		void drop_expired(Shard& shard, const EntryPtr& e) {
+			std::lock_guard lock(shard.mutex);
+			auto current = shard.entries.get(e->key);
+			if (current.has_value() && current.value() == e) {
+				shard.entries.erase(e->key);
+				shard.unlink(e);
+			}
+		}
+
+	public:
+		explicit AsyncCache(size_t capacity, clock::duration ttl = clock::duration::zero(), Weigher weigher = nullptr, size_t shard_count = 16) :
+				default_ttl(ttl),
+				weigher(std::move(weigher)) {
+			capacity = std::max<size_t>(capacity, 1);
+			auto n = shards_for(capacity, shard_count);
+			// The first shards take the remainder: the shard capacities add up to capacity
+			for (size_t i = 0; i < n; i++) {
+				shards.push_back(std::make_unique<Shard>(capacity / n + (i < capacity % n ? 1 : 0)));
+			}
+		}
+
+		AsyncCache(const AsyncCache&) = delete;
+		AsyncCache& operator=(const AsyncCache&) = delete;
+
+		std::optional<V> get(const K& key) {
+			auto& shard = shard_for(key);
+			std::optional<V> value;
+			EntryPtr expired;
+			// In place: copying the shared_ptr out would write to its control block on every hit
+			shard.entries.visit(key, [&value, &expired](const EntryPtr& entry) {
+				if (entry->expired(clock::now())) {
+					expired = entry;
+					return;
+				}
+
+				// Avoid dirtying the cache line on every hit
+				if (!entry->referenced.load(std::memory_order_relaxed)) {
+					entry->referenced.store(true, std::memory_order_relaxed);
+				}
+				value = entry->value;
+			});
+
+			if (expired != nullptr) {
+				drop_expired(shard, expired);
+			}
+			return value;
+		}
+
+		void set(const K& key, const V& value) {
+			set(key, value, default_ttl);
+		}
+
+		void set(const K& key, const V& value, clock::duration ttl) {
+			auto& shard = shard_for(key);
+			auto e = make_entry(key, value, ttl);
+
+			std::lock_guard lock(shard.mutex);
+			shard.flights.cancel(key);
+			insert(shard, e);
+		}
+
+		bool erase(const K& key) {
+			auto& shard = shard_for(key);
+			std::lock_guard lock(shard.mutex);
+			shard.flights.cancel(key);
+			auto e = shard.entries.get(key);
+			if (!e.has_value()) {
+				return false;
+			}
+			shard.entries.erase(key);
+			shard.unlink(e.value());
+			return true;
+		}
+
+		// Amount of entries, including expired ones that were not dropped yet
+		[[nodiscard]] size_t size() {
+			size_t total = 0;
+			for (auto& shard : shards) {
+				std::lock_guard lock(shard->mutex);
+				total += shard->count;
+			}
+			return total;
+		}
+
+		[[nodiscard]] size_t weight() {
+			size_t total = 0;
+			for (auto& shard : shards) {
+				std::lock_guard lock(shard->mutex);
+				total += shard->weight;
+			}
+			return total;
+		}
+
+		/*
+		 * co_await cache.get_or_load(key, loader) returns the cached value, or caches and returns the result of
+		 * co_await loader(key). Concurrent misses on the same key share a single loader task. A set() or erase() of the
+		 * key while it loads wins: the load result is still returned to its awaiters, but not cached.
+		 */
+		template<typename Loader, typename TaskType = std::invoke_result_t<Loader&, const K&>>
+		requires std::same_as<typename TaskType::Lock, Task_lock<V>>
+		TaskType get_or_load(K key, Loader loader) {
+			auto cached = get(key);
+			if (cached.has_value()) {
+				co_return std::move(cached.value());
+			}
+
+			auto& shard = shard_for(key);
+			typename internal::Flights<K, V>::FlightPtr flight;
+			bool owner = false;
+			{
+				std::lock_guard lock(shard.mutex);
+				auto e = shard.entries.get(key);
+				if (e.has_value() && !e.value()->expired(clock::now())) {
+					cached = e.value()->value;
+				} else {
+					flight = shard.flights.join(key, owner);
+				}
+			}
+
+			if (cached.has_value()) {
+				co_return std::move(cached.value());
+			}
+
+			if (!owner) {
+				co_return co_await TaskType(flight);
+			}
+
+			auto flying = internal::Flights<K, V>::template fly<TaskType>(flight, [&loader, &key]() {
+				return loader(std::as_const(key));
+			}, [this, &shard, &key, flight](std::optional<V> result) {
+				std::optional<EntryPtr> e;
+				if (result.has_value()) {
+					e = make_entry(key, result.value(), default_ttl);
+				}
+
+				std::lock_guard lock(shard.mutex);
+				if (shard.flights.finish(key, flight) && e.has_value()) {
+					insert(shard, e.value());
+				}
+				return result;
+			});
+			co_return co_await flying;
+		}
+	};
+}
+
+#endif //COROUTINELIB_CC_ASYNC_CACHE_H
@@ -4,6 +4,7 @@
 #include "cc_task_locks.h"
 #include "cc_task_scheduler.h"
 #include "cc_logger.h"
+#include "cc_trace.h"
 
 namespace crlib {
 
@@ -21,42 +22,63 @@ namespace crlib {
 
     template<Lockable LockType>
 	struct TaskAwaiter {
+		// Queued on the lock while suspended, this awaiter living in the coroutine frame until then
+		struct Waiter : public internal::LockWaiter {
+			std::coroutine_handle<> handle;
+			BaseTaskScheduler* home = nullptr;
+		};
+
 		std::shared_ptr<LockType> lock;
+		Waiter waiter;
 
 		TaskAwaiter(std::shared_ptr<LockType> lock) : lock(lock) {
 
 		}
 
 		bool await_ready() requires EarlyLockable<LockType> {
-			return lock->completed.load();
+			return lock->is_completed();
 		}
 
         bool await_ready() requires (!EarlyLockable<LockType>) {
             return false;
         }
 
+		// The task completing resumes the coroutine on the scheduler it is awaiting from, inline if it completes there
 		template<typename PromiseType>
-		void await_suspend(std::coroutine_handle<PromiseType> h) requires EarlyLockable<LockType> {
-			if (!lock->completed.load()) {
-				lock->append_coroutine([h] ()  {
-					PromiseType::Scheduler::Schedule(h);
-				});
-			}
-			else {
-				PromiseType::Scheduler::Schedule(h);
+		bool await_suspend(std::coroutine_handle<PromiseType> h) requires EarlyLockable<LockType> {
+			CC_TRACE2(Await, h.address(), lock.get());
+			using Scheduler = typename PromiseType::Scheduler;
+			internal::Continuation<Scheduler> c(h);
+			waiter.handle = c.handle;
+			waiter.home = c.home;
+			waiter.run = [](internal::LockWaiter* w) {
+				auto self = static_cast<Waiter*>(w);
+				internal::Continuation<Scheduler>(self->handle, self->home).resume(true);
+			};
+
+			// The coroutine may be resumed, and this awaiter destroyed, before append() returns
+			auto l = lock.get();
+			internal::SuspendScope scope(h);
+			if (!l->append(&waiter)) {
+				return false;
 			}
+			return scope.suspend();
 		}
 
 		template<typename PromiseType>
-		void await_suspend(std::coroutine_handle<PromiseType> h) requires (!EarlyLockable<LockType>) {
-			lock->append_coroutine([h] () {
-				PromiseType::Scheduler::Schedule(h);
+		bool await_suspend(std::coroutine_handle<PromiseType> h) requires (!EarlyLockable<LockType>) {
+			CC_TRACE2(Await, h.address(), lock.get());
+			auto l = lock;
+			internal::SuspendScope scope(h);
+			l->append_coroutine([c = internal::Continuation<typename PromiseType::Scheduler>(h)] () {
+				c.resume(true);
 			});
+			return scope.suspend();
 		}
 
         inline void rethrow_exception() requires ExceptionHolder<LockType> {
-            if (lock->exception.has_value()) {
-                std::rethrow_exception(lock->exception.value());
+            if (lock->exception != nullptr) {
+                std::rethrow_exception(lock->exception);
             }
         }
 
@@ -94,15 +116,18 @@ namespace crlib {
 		}
 
 		template<typename PromiseType>
-		void await_suspend(std::coroutine_handle<PromiseType> h) {
-			if (lock->add_awaiter([h]() -> void {
-				PromiseType::Scheduler::Schedule(h);
+		bool await_suspend(std::coroutine_handle<PromiseType> h) {
+			// Once the awaiter is added, the coroutine may be resumed, and this awaiter destroyed, at any moment
+			succeeded.store(true);
+			internal::SuspendScope scope(h);
+			if (lock->add_awaiter([c = internal::Continuation<typename PromiseType::Scheduler>(h)]() -> void {
+				c.resume(true);
 			})) {
-				succeeded.store(true);
-			} else {
-				succeeded.store(false);
-				PromiseType::Scheduler::Schedule(h);
+				return scope.suspend();
 			}
+
+			succeeded.store(false);
+			return false;
 		}
 
 		T&& await_resume() {
@@ -160,7 +185,7 @@ namespace crlib {
 
 		bool await_ready() requires EarlyLockable<LockType> {
 			for(auto& t : ctrl_block->task_locks) {
-				if (!t->completed.load()) {
+				if (!t->is_completed()) {
 					return false;
 				}
 			}
@@ -172,43 +197,55 @@ namespace crlib {
 			return false;
 		}
 
-		template<typename PromiseType>
-		void increase_and_schedule(std::coroutine_handle<PromiseType> h) {
-			size_t old = ctrl_block->completed_tasks.fetch_add(1);
+		template<typename Scheduler>
+		static void increase_and_schedule(MultiTaskAwaiter_ctrl* ctrl, const internal::Continuation<Scheduler>& c) {
+			// Once counted, the last completion may resume the coroutine, and destroy ctrl
+			auto count = ctrl->tasks_count;
+			size_t old = ctrl->completed_tasks.fetch_add(1);
 
-			if (old == ctrl_block->tasks_count - 1) {
-				PromiseType::Scheduler::Schedule(h);
+			if (old == count - 1) {
+				c.resume(true);
 			}
 		}
 
 		template<typename PromiseType>
-		void await_suspend(std::coroutine_handle<PromiseType> h) requires EarlyLockable<LockType> {
-			for (auto& t : ctrl_block->task_locks) {
-				if (t->completed.load()) {
-					increase_and_schedule(h);
+		bool await_suspend(std::coroutine_handle<PromiseType> h) requires EarlyLockable<LockType> {
+			// The last completion resumes the coroutine, which may destroy this awaiter before the loop ends
+			auto ctrl = ctrl_block;
+			internal::SuspendScope scope(h);
+			internal::Continuation<typename PromiseType::Scheduler> c(h);
+			for (auto& t : ctrl->task_locks) {
+				if (t->is_completed()) {
+					increase_and_schedule(ctrl.get(), c);
 				} else {
-					t->append_coroutine([this, h]() {
-						increase_and_schedule(h);
+					// Locks keep their last continuation alive, which must not own ctrl in turn
+					t->append_coroutine([ctrl = ctrl.get(), c]() {
+						increase_and_schedule(ctrl, c);
 					});
 				}
 			}
+			return scope.suspend();
 		}
 
 		template<typename PromiseType>
-		void await_suspend(std::coroutine_handle<PromiseType> h) requires (!EarlyLockable<LockType>) {
-			for (auto& t : ctrl_block->task_locks) {
-				t->append_coroutine([this, h]() {
-					increase_and_schedule(h);
+		bool await_suspend(std::coroutine_handle<PromiseType> h) requires (!EarlyLockable<LockType>) {
+			auto ctrl = ctrl_block;
+			internal::SuspendScope scope(h);
+			internal::Continuation<typename PromiseType::Scheduler> c(h);
+			for (auto& t : ctrl->task_locks) {
+				t->append_coroutine([ctrl = ctrl.get(), c]() {
+					increase_and_schedule(ctrl, c);
 				});
 			}
+			return scope.suspend();
 		}
 
 		void await_resume() {
 			std::vector<std::exception_ptr> exceptions;
 
 			for (auto& t : ctrl_block->task_locks) {
-				if (t->exception.has_value()) {
-					exceptions.push_back(t->exception.value());
+				if (t->exception != nullptr) {
+					exceptions.push_back(t->exception);
 				}
 			}
 
@@ -235,21 +272,22 @@ namespace crlib {
 		}
 
 		template<typename PromiseType>
-		void await_suspend(std::coroutine_handle<PromiseType> h) {
+		bool await_suspend(std::coroutine_handle<PromiseType> h) {
 			if (lock->completed.load()) {
 				//Generator task is completed, return std::nullopt
-				PromiseType::Scheduler::Schedule(h);
-				return;
+				return false;
 			}
 
-			if(lock->waiting_queue.push([h, this](std::optional<T> value) -> void {
+			// Once queued, the coroutine may be resumed and this awaiter destroyed before wake() returns
+			auto l = lock;
+			internal::SuspendScope scope(h);
+			if(l->waiting_queue.push([c = internal::Continuation<typename PromiseType::Scheduler>(h), this](std::optional<T> value) -> void {
 				this->val = std::move(value);
-				if (this->val.has_value()) {
-				}
-				PromiseType::Scheduler::Schedule(h);
+				c.resume();
 			})) {
 
-				lock->wake();
+				l->wake();
+				return scope.suspend();
 			} else {
 				//Too many items waiting in queue
 				throw std::runtime_error("Coroutine queue full");
@@ -268,12 +306,27 @@ namespace crlib {
 		}
 
 		bool await_ready() requires InlineableTaskScheduler<T> {
+#ifdef CRLIB_TRACING
+			// await_suspend records the task, and inlines it from there
+			return false;
+#else
 			return T::CanInline();
+#endif
 		}
 
 		template<typename PromiseType>
-		void await_suspend(std::coroutine_handle<PromiseType> h) {
+		bool await_suspend(std::coroutine_handle<PromiseType> h) {
+#ifdef CRLIB_TRACING
+			h.promise().trace_frame = h.address();
+			CC_TRACE(Create, h.address());
+			if constexpr (InlineableTaskScheduler<T>) {
+				if (T::CanInline()) {
+					return false;
+				}
+			}
+#endif
 			PromiseType::Scheduler::Schedule(h);
+			return true;
 		}
 
 		void await_resume() {
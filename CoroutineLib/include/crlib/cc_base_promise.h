@@ -4,46 +4,78 @@
 #include "cc_task_locks.h"
 #include "cc_task_types.h"
 #include "cc_awaitables.h"
+#include "cc_inspector.h"
 
 namespace crlib {
 	template<IsSchedulable TaskType, typename LockType>
 	struct BasePromise {
 		using Scheduler = typename TaskType::Scheduler;
 		std::shared_ptr<LockType> lock;
+#ifdef CRLIB_TRACING
+		// Address of the coroutine frame, which identifies the task in traces
+		void* trace_frame = nullptr;
+#endif
+#ifdef CRLIB_INSPECTOR
+		internal::InspectorFrame inspector;
 
-		BasePromise() : lock(new LockType()) {
+		// Promise types forward the location of the coroutine from their own constructor's default argument
+		explicit BasePromise(std::source_location location) : lock(new LockType()), inspector(location, lock.get()) {
 
 		}
+#endif
+
+		BasePromise() : lock(new LockType())
+#ifdef CRLIB_INSPECTOR
+			, inspector(std::source_location(), lock.get())
+#endif
+		{
+
+		}
+
+		// Builds the awaiter A from args, wrapped to keep the inspector up to date
+		template<typename A, typename ... Args>
+		internal::Inspected<A> inspected(Args&& ... args) {
+#ifdef CRLIB_INSPECTOR
+			return internal::Inspected<A>(inspector, TaskState::Suspended, std::forward<Args>(args)...);
+#else
+			return A(std::forward<Args>(args)...);
+#endif
+		}
 
 		TaskType get_return_object() {
 			return TaskType(lock);
 		}
 
-		crlib::TaskAwaitable<Scheduler> initial_suspend() {
+		internal::Inspected<crlib::TaskAwaitable<Scheduler>> initial_suspend() {
+#ifdef CRLIB_INSPECTOR
+			return {inspector, TaskState::Scheduled};
+#else
 			return {};
+#endif
 		}
 
         template<HasLock LocalTaskType>
-		crlib::TaskAwaiter<typename LocalTaskType::Lock> await_transform(const LocalTaskType& task) {
-			return {task.lock};
+		internal::Inspected<crlib::TaskAwaiter<typename LocalTaskType::Lock>> await_transform(const LocalTaskType& task) {
+			return inspected<crlib::TaskAwaiter<typename LocalTaskType::Lock>>(task.lock);
 		}
 
 		template<Awaitable T>
-		T await_transform(const T& t) {
-			return t;
+		internal::Inspected<T> await_transform(const T& t) {
+			return inspected<T>(t);
 		}
 
 		template<typename TT, IsTaskScheduler Scheduler>
-		crlib::GeneratorTask_Awaiter<TT> await_transform(const crlib::GeneratorTask<TT, Scheduler>& task) {
-			return crlib::GeneratorTask_Awaiter<TT>(task.lock);
+		internal::Inspected<crlib::GeneratorTask_Awaiter<TT>> await_transform(const crlib::GeneratorTask<TT, Scheduler>& task) {
+			return inspected<crlib::GeneratorTask_Awaiter<TT>>(task.lock);
 		}
 
 		template<typename TT, IsTaskScheduler Scheduler>
-		crlib::ValueTaskAwaiter<TT> await_transform(const crlib::ValueTask<TT, Scheduler>& task) {
-			return crlib::ValueTaskAwaiter<TT>(task.lock);
+		internal::Inspected<crlib::ValueTaskAwaiter<TT>> await_transform(const crlib::ValueTask<TT, Scheduler>& task) {
+			return inspected<crlib::ValueTaskAwaiter<TT>>(task.lock);
 		}
 
 		std::suspend_never final_suspend() noexcept {
+			CC_TRACE(Complete, trace_frame);
 			lock->complete();
 			return {};
 		}
@@ -3,6 +3,7 @@
 #include <memory>
 #include <optional>
 #include <atomic>
+#include "cc_epoch.h"
 namespace crlib {
 	template<typename T>
 	struct BoundlessQueueNode;
@@ -19,13 +20,6 @@ namespace crlib {
 		BoundlessQueueNode(std::optional<T> val, ptr_t next) : value(std::move(val)), next(std::move(next)) {
 
 		}
-
-		~BoundlessQueueNode() {
-			auto v = next.load();
-			if (v != nullptr) {
-				delete v;
-			}
-		}
 	};
 
 	template<typename T>
@@ -44,25 +38,40 @@ namespace crlib {
 
 		bool push(T val) {
 			ptr_t node = new BoundlessQueueNode<T>(std::move(val), nullptr);
+			EpochGuard guard;
 			ptr_t t, next;
 			while(true) {
-				t = tail.load(std::memory_order_relaxed);
-				next = t->next.load(std::memory_order_relaxed);
-				if (t == tail.load(std::memory_order_relaxed)) {
+				t = tail.load(std::memory_order_acquire);
+				next = t->next.load(std::memory_order_acquire);
+				if (t == tail.load(std::memory_order_acquire)) {
 					if (next == nullptr) {
-						if (t->next.compare_exchange_strong(next, node, std::memory_order_relaxed)) {
+						if (t->next.compare_exchange_strong(next, node, std::memory_order_release, std::memory_order_relaxed)) {
 							break;
 						}
 					} else {
-						tail.compare_exchange_strong(t, next, std::memory_order_relaxed);
+						tail.compare_exchange_strong(t, next, std::memory_order_release, std::memory_order_relaxed);
 					}
 				}
 			}
-			tail.compare_exchange_strong(t, node, std::memory_order_relaxed);
+			tail.compare_exchange_strong(t, node, std::memory_order_release, std::memory_order_relaxed);
+			return true;
+		}
+
+		/*
+		 * push() for a queue that only the calling thread pushes to. Pullers only reclaim nodes that the head moved past,
+		 * and the head never passes the tail: with no other pusher, the tail stays the last node and needs no EpochGuard.
+		 */
+		bool push_single_producer(T val) {
+			ptr_t node = new BoundlessQueueNode<T>(std::move(val), nullptr);
+			ptr_t t = tail.load(std::memory_order_acquire);
+			t->next.store(node, std::memory_order_release);
+			tail.compare_exchange_strong(t, node, std::memory_order_release, std::memory_order_relaxed);
 			return true;
 		}
 
 		std::optional<T> pull() {
+			// Other threads may still be reading a node after it has been dequeued: nodes are reclaimed through Epoch
+			EpochGuard guard;
 			while(true) {
 				ptr_t h = head.load();
 				ptr_t t = tail.load();
@@ -74,11 +83,12 @@ namespace crlib {
 						}
 						tail.compare_exchange_weak(t, next);
 					} else {
-						auto val = next->value;
 						if (head.compare_exchange_weak(h, next)) {
-							h->next.store(nullptr);
-							next->value = std::nullopt;
-							delete h;
+							// next is the new dummy: only the puller dequeuing it touches its value, which must not
+							// stay alive in it until the next pull
+							std::optional<T> val = std::move(next->value);
+							next->value.reset();
+							Epoch::retire(h);
 							return val;
 						}
 					}
@@ -90,7 +100,6 @@ namespace crlib {
 			auto h = head.load();
 			while (h != nullptr) {
 				auto next = h->next.load();
-				h->next.store(nullptr);
 				delete h;
 				h = next;
 			}
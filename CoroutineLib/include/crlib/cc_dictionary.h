@@ -5,274 +5,513 @@
 #include <optional>
 #include <vector>
 #include <mutex>
+#include <atomic>
 #include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <type_traits>
+#include <exception>
+#include "cc_epoch.h"
 
 #undef min
 #undef max
 
 namespace crlib {
+	// Only needed by get_or_add_async(), whose factories return a Task
+	template<typename T>
+	struct Task_lock;
+
+	namespace internal {
+		// std::hash is the identity for integers, spread the bits before masking with a power of two
+		inline size_t mix_hash(size_t h) {
+			auto x = static_cast<uint64_t>(h);
+			x ^= x >> 33;
+			x *= 0xff51afd7ed558ccdULL;
+			x ^= x >> 33;
+			return static_cast<size_t>(x);
+		}
+
+		inline size_t next_power_of_two(size_t n) {
+			size_t p = 1;
+			while (p < n) {
+				p <<= 1;
+			}
+			return p;
+		}
+
+		/*
+		 * Single-flight bookkeeping, shared by ConcurrentDictionary::get_or_add_async() and AsyncCache::get_or_load():
+		 * the loads of missing keys still running, so that concurrent misses await the same one.
+		 * Only accessed with the mutex of its owner held, except for fly().
+		 */
+		template<typename K, typename V>
+		struct Flights {
+			using FlightPtr = std::shared_ptr<Task_lock<V>>;
+
+			std::unordered_map<K, FlightPtr> running;
+
+			// Returns the flight of key, registering a new one if there is none: the caller then owns it, and must fly() it
+			FlightPtr join(const K& key, bool& owner) {
+				auto it = running.find(key);
+				if (it != running.end()) {
+					owner = false;
+					return it->second;
+				}
+
+				// The factory must not run under the mutex (its task may start inline, and call back in here):
+				// the other callers wait on this placeholder, completed by fly()
+				auto flight = std::make_shared<Task_lock<V>>();
+				running.emplace(key, flight);
+				owner = true;
+				return flight;
+			}
+
+			// Unregisters flight. Returns false if it was cancelled since, its result must then not be stored
+			bool finish(const K& key, const FlightPtr& flight) {
+				auto it = running.find(key);
+				if (it == running.end() || it->second != flight) {
+					return false;
+				}
+				running.erase(it);
+				return true;
+			}
+
+			// The key's flight still completes, for the callers awaiting it, but finish() reports it as cancelled
+			void cancel(const K& key) {
+				running.erase(key);
+			}
+
+			/*
+			 * Runs the owned flight: awaits factory(), then hands its result (nullopt if it threw) to settle(), which stores
+			 * it and finishes the flight. The callers awaiting the flight get the value settle() returns, or the exception.
+			 */
+			template<typename TaskType, typename Factory, typename Settle>
+			static TaskType fly(FlightPtr flight, Factory factory, Settle settle) {
+				std::optional<V> result;
+				std::exception_ptr error;
+				try {
+					auto task = factory();
+					result = co_await task;
+				} catch (...) {
+					error = std::current_exception();
+				}
+
+				auto value = settle(std::move(result));
+				if (error) {
+					flight->exception = error;
+					flight->complete();
+					std::rethrow_exception(error);
+				}
+				flight->set_result(value.value());
+				flight->complete();
+				co_return std::move(value.value());
+			}
+		};
+	}
+
+	/*
+	 * Entries are immutable once published: set() replaces the whole entry and erase() unlinks it,
+	 * the old one is then reclaimed through Epoch once no reader can still be walking it.
+	 */
 	template<typename K, typename V>
 	struct ConcurrentDictionaryEntry {
 		using entry_t = ConcurrentDictionaryEntry<K, V>;
 
-		K key;
-		V value;
-		entry_t* next = nullptr;
+		const K key;
+		const V value;
+		const size_t hash;
+		std::atomic<entry_t*> next;
 
 		ConcurrentDictionaryEntry() = delete;
-		ConcurrentDictionaryEntry(const K& key, const V& value) : key(key), value(value) {
+		ConcurrentDictionaryEntry(const K& key, const V& value, size_t hash, entry_t* next) : key(key), value(value), hash(hash), next(next) {
 
 		}
-
-		~ConcurrentDictionaryEntry() {
-			if (next != nullptr) {
-				delete next;
-			}
-		}
 	};
 
+	/*
+	 * Chained hash map with lock-free reads.
+	 * get() and iteration never take a lock. Writers lock one stripe, selected by the key hash: the amount of stripes never
+	 * exceeds the amount of buckets, so a stripe always covers the same buckets across resizes.
+	 * Resizing does not stop the world: a bigger table is linked to the current one and buckets are migrated one at a time,
+	 * either by the writer that needs them or in small batches by every writer. A migrated bucket is marked as moved,
+	 * and readers that find the marker continue into the next table.
+	 * Iterators hold an EpochGuard: they must not be kept across a co_await.
+	 */
 	template<typename K, typename V>
 	class ConcurrentDictionary {
 	public:
 		using entry_t = ConcurrentDictionaryEntry<K, V>;
 	protected:
-		using buckets_t = std::shared_ptr<std::vector<entry_t*>>;
+		struct Table {
+			const size_t mask;
+			std::unique_ptr<std::atomic<entry_t*>[]> buckets;
+			std::atomic<Table*> next_table;
+			std::atomic<size_t> migrate_cursor;
+			std::atomic<size_t> migrated;
+
+			explicit Table(size_t size) : mask(size - 1), buckets(new std::atomic<entry_t*>[size]()), next_table(nullptr), migrate_cursor(0), migrated(0) {
+
+			}
+
+			size_t size() const {
+				return mask + 1;
+			}
+		};
 
-		buckets_t buckets;
+		static constexpr size_t migrate_batch = 16;
+		static constexpr size_t max_stripes = 1024;
+
+		static entry_t* moved() {
+			return reinterpret_cast<entry_t*>(static_cast<uintptr_t>(1));
+		}
+
+		std::atomic<Table*> table;
 		std::vector<std::mutex> locks;
+		const size_t max_table_size;
+		std::atomic<size_t> count;
+		// Factory tasks of get_or_add_async() that are still running, only touched on misses
+		std::mutex flights_mutex;
+		internal::Flights<K, V> flights;
+
+		static size_t hash_of(const K& key) {
+			return internal::mix_hash(static_cast<size_t>(std::hash<K>()(key)));
+		}
 
-		size_t get_bucket_idx(const K& key, size_t buckets_n) {
-			return static_cast<size_t>(std::hash<K>()(key)) % buckets_n;
+		std::mutex& stripe(size_t hash) {
+			return locks[hash & (locks.size() - 1)];
 		}
 
-		static size_t append_entry(buckets_t buckets, size_t bucket_idx, entry_t* new_entry) {
-			size_t i = 0;
+		// Must hold the stripe lock of bucket 'idx'
+		void migrate_bucket(Table* t, Table* nt, size_t idx) {
+			auto& bucket = t->buckets[idx];
+			auto e = bucket.load(std::memory_order_acquire);
 
-			if ((*buckets)[bucket_idx] == nullptr) {
-				(*buckets)[bucket_idx] = new_entry;
-				return 1;
-			}
+			// Readers may still be walking the old chain: copy it instead of relinking the entries
+			while (e != nullptr) {
+				auto& target = nt->buckets[e->hash & nt->mask];
+				target.store(new entry_t(e->key, e->value, e->hash, target.load(std::memory_order_relaxed)), std::memory_order_release);
 
-			auto tail = (*buckets)[bucket_idx];
+				auto next = e->next.load(std::memory_order_relaxed);
+				Epoch::retire(e);
+				e = next;
+			}
+			bucket.store(moved(), std::memory_order_release);
 
-			while (tail != nullptr && tail->next != nullptr) {
-				i++;
-				tail = tail->next;
+			if (t->migrated.fetch_add(1, std::memory_order_acq_rel) + 1 == t->size()) {
+				table.store(nt, std::memory_order_release);
+				Epoch::retire(t);
 			}
+		}
 
-			tail->next = std::move(new_entry);
-			i++;
+		// Must hold the stripe lock of 'hash'. Returns the newest table, after migrating the key's bucket to it
+		Table* table_for_write(size_t hash) {
+			auto t = table.load(std::memory_order_acquire);
+			while (true) {
+				auto nt = t->next_table.load(std::memory_order_acquire);
+				if (nt == nullptr) {
+					return t;
+				}
 
-			return i;
+				auto idx = hash & t->mask;
+				if (t->buckets[idx].load(std::memory_order_relaxed) != moved()) {
+					migrate_bucket(t, nt, idx);
+				}
+				t = nt;
+			}
 		}
 
-		void expand() noexcept {
-			auto bks = buckets;
-
-			if (bks->size() >= locks.size()) {
+		void start_resize(Table* t) {
+			if (t->size() >= max_table_size || t->next_table.load(std::memory_order_relaxed) != nullptr) {
 				return;
 			}
 
-			locks[0].lock();
+			auto nt = new Table(t->size() * 2);
+			Table* expected = nullptr;
+			if (!t->next_table.compare_exchange_strong(expected, nt, std::memory_order_acq_rel)) {
+				delete nt;
+			}
+		}
 
-			if (bks != buckets) {
-				locks[0].unlock();
+		void help_migrate() {
+			auto t = table.load(std::memory_order_acquire);
+			auto nt = t->next_table.load(std::memory_order_acquire);
+			if (nt == nullptr) {
 				return;
 			}
 
-
-			auto next_size = std::min(bks->size() * 2U, locks.size());
-
-			auto next_buckets = std::make_shared<std::vector<entry_t*>>(next_size);
-
-			for(size_t i = 1; i < locks.size(); i++) {
-				locks[i].lock();
+			auto start = t->migrate_cursor.fetch_add(migrate_batch, std::memory_order_relaxed);
+			auto end = std::min(start + migrate_batch, t->size());
+			for (auto i = start; i < end; i++) {
+				std::lock_guard lock(stripe(i));
+				if (t->buckets[i].load(std::memory_order_relaxed) != moved()) {
+					migrate_bucket(t, nt, i);
+				}
 			}
+		}
 
-			for(auto& head : (*bks)) {
-				auto head_val = head;
-				if (head_val == nullptr) {
+		static void free_table(Table* t) {
+			for (size_t i = 0; i < t->size(); i++) {
+				auto e = t->buckets[i].load(std::memory_order_relaxed);
+				if (e == moved()) {
 					continue;
 				}
+				while (e != nullptr) {
+					auto next = e->next.load(std::memory_order_relaxed);
+					delete e;
+					e = next;
+				}
+			}
+			delete t;
+		}
 
-				auto val = head_val;
-
-				while(val != nullptr) {
-					auto idx = get_bucket_idx(val->key, next_size);
-					auto nval = new entry_t(*val);
-					nval->next = nullptr;
-					append_entry(next_buckets, idx, nval);
-					val = val->next;
+		V insert(const K& key, const V& val, bool replace) {
+			auto hash = hash_of(key);
+			EpochGuard g;
+			Table* t;
+			{
+				std::lock_guard lock(stripe(hash));
+				t = table_for_write(hash);
+
+				auto& bucket = t->buckets[hash & t->mask];
+				auto head = bucket.load(std::memory_order_relaxed);
+				auto prev = &bucket;
+				for (auto e = head; e != nullptr; e = e->next.load(std::memory_order_relaxed)) {
+					if (e->hash == hash && e->key == key) {
+						if (!replace) {
+							return e->value;
+						}
+						prev->store(new entry_t(key, val, hash, e->next.load(std::memory_order_relaxed)), std::memory_order_release);
+						Epoch::retire(e);
+						return val;
+					}
+					prev = &e->next;
 				}
+
+				bucket.store(new entry_t(key, val, hash, head), std::memory_order_release);
 			}
 
-			buckets = std::move(next_buckets); //This should be atomic, if it isn't, big trouble
+			if (count.fetch_add(1, std::memory_order_relaxed) + 1 > t->size()) {
+				start_resize(t);
+			}
+			help_migrate();
+			return val;
+		}
 
-			for(auto& l : locks) {
-				l.unlock();
+		// Must hold an EpochGuard, for as long as the entry is used
+		entry_t* find(const K& key) const {
+			auto hash = hash_of(key);
+			auto t = table.load(std::memory_order_acquire);
+			auto e = t->buckets[hash & t->mask].load(std::memory_order_acquire);
+			while (e == moved()) {
+				t = t->next_table.load(std::memory_order_acquire);
+				e = t->buckets[hash & t->mask].load(std::memory_order_acquire);
 			}
+
+			while (e != nullptr) {
+				if (e->hash == hash && e->key == key) {
+					return e;
+				}
+				e = e->next.load(std::memory_order_acquire);
+			}
+			return nullptr;
 		}
 
-		struct iterator_point {
-			buckets_t buckets;
-			size_t bucket_idx;
-			entry_t* entry;
-		};
 	public:
 
 		struct Iterator {
 		private:
-			iterator_point pt;
+			EpochGuard guard;
+			Table* root = nullptr;
+			size_t root_idx = 0;
+			// Buckets of the following tables that replaced an already migrated bucket of 'root'
+			std::vector<std::pair<Table*, size_t>> pending;
+			entry_t* entry = nullptr;
+
+			void next_bucket() {
+				while (true) {
+					Table* t;
+					size_t idx;
+					if (!pending.empty()) {
+						std::tie(t, idx) = pending.back();
+						pending.pop_back();
+					} else if (root != nullptr && ++root_idx < root->size()) {
+						t = root;
+						idx = root_idx;
+					} else {
+						entry = nullptr;
+						return;
+					}
+
+					auto head = t->buckets[idx].load(std::memory_order_acquire);
+					if (head == moved()) {
+						auto nt = t->next_table.load(std::memory_order_acquire);
+						pending.emplace_back(nt, idx + t->size());
+						pending.emplace_back(nt, idx);
+					} else if (head != nullptr) {
+						entry = head;
+						return;
+					}
+				}
+			}
+
 		public:
 			using iterator_category = std::input_iterator_tag;
 			using value_type = std::pair<K, V>;
 
 			Iterator() = default;
-			explicit Iterator(iterator_point p) {
-				pt = p;
+			explicit Iterator(Table* t) : root(t), root_idx(0) {
+				pending.emplace_back(t, 0);
+				next_bucket();
 			}
 
 			value_type operator*() const {
-				return {pt.entry->key, pt.entry->value};
+				return {entry->key, entry->value};
 			}
 
 			Iterator& operator++() {
-				if (pt.entry->next != nullptr) {
-					pt.entry = pt.entry->next;
-					return *this;
-				}
-
-				size_t i = pt.bucket_idx + 1;
-				while(i < pt.buckets->size()) {
-					if ((*pt.buckets)[i] != nullptr) {
-						pt.bucket_idx = i;
-						pt.entry = (*pt.buckets)[i];
-						return *this;
-					}
-					i++;
+				auto next = entry->next.load(std::memory_order_acquire);
+				if (next != nullptr) {
+					entry = next;
+				} else {
+					next_bucket();
 				}
-
-				pt.entry = nullptr;
 				return *this;
 			}
 
 			friend bool operator!= (const Iterator& a, const Iterator& b) {
-				return a.pt.entry != b.pt.entry;
+				return a.entry != b.entry;
 			}
 
 		};
 
-
 		explicit ConcurrentDictionary(size_t initial_buckets_n = 64, size_t max_buckets_n = 1024) :
-				buckets(std::make_shared<std::vector<entry_t*>>(std::max<size_t>(initial_buckets_n, 1))),
-		locks(std::max(max_buckets_n, std::max<size_t>(initial_buckets_n, 64))) {
+				table(new Table(internal::next_power_of_two(std::max<size_t>(initial_buckets_n, 1)))),
+				locks(std::min(internal::next_power_of_two(std::max<size_t>(initial_buckets_n, 1)), max_stripes)),
+				max_table_size(internal::next_power_of_two(std::max(max_buckets_n, initial_buckets_n))),
+				count(0) {
 		}
 
-		Iterator begin() {
-			for (size_t i = 0; i < buckets->size(); i++) {
-				if ((*buckets)[i] != nullptr) {
-					return  Iterator(iterator_point{buckets, i, (*buckets)[i]});
-				}
+		ConcurrentDictionary(const ConcurrentDictionary&) = delete;
+		ConcurrentDictionary& operator=(const ConcurrentDictionary&) = delete;
+
+		~ConcurrentDictionary() {
+			auto t = table.load(std::memory_order_acquire);
+			while (t != nullptr) {
+				auto nt = t->next_table.load(std::memory_order_acquire);
+				free_table(t);
+				t = nt;
 			}
+		}
 
-			return end();
+		Iterator begin() {
+			EpochGuard g;
+			return Iterator(table.load(std::memory_order_acquire));
 		}
 
 		Iterator end() {
-			return Iterator(iterator_point{buckets, 0, nullptr});
+			return Iterator();
 		}
 
-		void set(const K& key, const V& val) {
-			auto entry = new entry_t(key, val);
-			entry->next = nullptr;
-
-			while (true) {
-				auto bks = buckets;
-				auto idx = get_bucket_idx(key, bks->size());
-				auto lock_idx = idx % locks.size();
-
-				size_t i = 0;
-				{
-					std::lock_guard lock(locks[lock_idx]);
-
-					if (bks != buckets) {
-						continue;
-					}
-
-					auto current_entry = (*bks)[idx];
-
-					while(current_entry != nullptr) {
-						if (current_entry->key == key) {
-							current_entry->value = val;
-							return;
-						}
-						current_entry = current_entry->next;
-					}
+		[[nodiscard]] size_t size() const {
+			return count.load(std::memory_order_relaxed);
+		}
 
-					i = append_entry(buckets, idx, entry);
-				}
+		void set(const K& key, const V& val) {
+			insert(key, val, true);
+		}
 
-				if (i >= bks->size()) {
-					expand();
-				}
-				break;
-			}
+		// Stores val, unless key already has a value. Returns the value stored for key
+		V get_or_add(const K& key, const V& val) {
+			return insert(key, val, false);
 		}
 
 		bool erase(const K& key) {
-			while(true) {
-				auto bks = buckets;
-				auto idx = get_bucket_idx(key, bks->size());
-				auto lock_idx = idx % locks.size();
-
-				std::lock_guard lock(locks[lock_idx]);
-
-				if (bks != buckets) {
-					continue;
+			auto hash = hash_of(key);
+			EpochGuard g;
+			std::lock_guard lock(stripe(hash));
+			auto t = table_for_write(hash);
+
+			auto prev = &t->buckets[hash & t->mask];
+			for (auto e = prev->load(std::memory_order_relaxed); e != nullptr; e = e->next.load(std::memory_order_relaxed)) {
+				if (e->hash == hash && e->key == key) {
+					prev->store(e->next.load(std::memory_order_relaxed), std::memory_order_release);
+					Epoch::retire(e);
+					count.fetch_sub(1, std::memory_order_relaxed);
+					return true;
 				}
+				prev = &e->next;
+			}
 
-				auto prev = (*bks)[idx];
+			return false;
+		}
 
-				if (prev == nullptr) {
-					return false;
-				}
+		/*
+		 * co_await dict.get_or_add_async(key, factory) returns the value stored for 'key', or runs factory() (which returns a Task<V>)
+		 * and stores its result. Concurrent callers missing the same key all await the same factory task instead of running their own.
+		 * A value stored by another writer while the factory runs wins over its result, which is then dropped.
+		 * If the factory fails, its awaiters get the exception and nothing is stored: the next call runs the factory again.
+		 */
+		template<typename Factory, typename TaskType = std::invoke_result_t<Factory&>>
+		requires std::same_as<typename TaskType::Lock, Task_lock<V>>
+		TaskType get_or_add_async(K key, Factory factory) {
+			auto cached = get(key);
+			if (cached.has_value()) {
+				co_return std::move(cached.value());
+			}
 
-				if (prev->key == key) {
-					(*bks)[idx] = prev->next;
-					prev->next == nullptr;
-					delete prev;
-					return true;
+			typename internal::Flights<K, V>::FlightPtr flight;
+			bool owner = false;
+			{
+				std::lock_guard lock(flights_mutex);
+				cached = get(key);
+				if (!cached.has_value()) {
+					flight = flights.join(key, owner);
 				}
+			}
 
-				while(prev->next != nullptr) {
-					if (prev->next->key == key) {
-						auto vl = prev->next;
-						prev->next = prev->next->next;
-						vl->next = nullptr;
-						delete vl;
-						return true;
-					}
-					prev = prev->next;
-				}
+			if (cached.has_value()) {
+				co_return std::move(cached.value());
+			}
 
-				return false;
+			if (!owner) {
+				co_return co_await TaskType(flight);
 			}
+
+			auto flying = internal::Flights<K, V>::template fly<TaskType>(flight, [&factory]() {
+				return factory();
+			}, [this, &key, flight](std::optional<V> result) {
+				// Stored before the flight is unregistered: from then on, callers either find a value or start a new flight
+				std::lock_guard lock(flights_mutex);
+				if (result.has_value()) {
+					result = get_or_add(key, result.value());
+				}
+				flights.finish(key, flight);
+				return result;
+			});
+			co_return co_await flying;
 		}
 
 		std::optional<V> get(const K& key) {
-			auto bks = buckets;
-			auto idx = get_bucket_idx(key, bks->size());
-
-			auto e = (*bks)[idx];
-
-			while(e != nullptr) {
-				if (key == e->key) {
-					return e->value;
-				}
-				e = e->next;
+			EpochGuard g;
+			auto e = find(key);
+			if (e == nullptr) {
+				return std::nullopt;
 			}
+			return e->value;
+		}
 
-			return std::nullopt;
+		// Calls f with the value stored for key, without copying it. Returns false if there is none.
+		// f runs under an EpochGuard: it should be quick, and must not keep a reference to the value
+		template<typename F>
+		bool visit(const K& key, F&& f) {
+			EpochGuard g;
+			auto e = find(key);
+			if (e == nullptr) {
+				return false;
+			}
+			f(e->value);
+			return true;
 		}
 	};
 }
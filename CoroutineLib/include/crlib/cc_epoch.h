@@ -0,0 +1,47 @@
+#ifndef COROUTINELIB_CC_EPOCH_H
+#define COROUTINELIB_CC_EPOCH_H
+
+#include "cc_api.h"
+
+namespace crlib {
+	/*
+	 * Epoch based memory reclamation, for lock-free structures whose readers may still hold pointers
+	 * to nodes that writers already unlinked. Readers wrap their accesses in an EpochGuard (which is re-entrant),
+	 * writers hand unlinked nodes to Epoch::retire(): they are freed once every thread that could still see them
+	 * has left its guard.
+	 */
+	struct Epoch {
+		CRLIB_API static void enter();
+		CRLIB_API static void exit();
+		CRLIB_API static void retire(void* ptr, void (*deleter)(void*));
+		// Tries to advance the global epoch and frees what this thread retired and is now unreachable
+		CRLIB_API static void collect();
+
+		template<typename T>
+		static void retire(T* ptr) {
+			retire(static_cast<void*>(ptr), [](void* p) {
+				delete static_cast<T*>(p);
+			});
+		}
+	};
+
+	struct EpochGuard {
+		EpochGuard() {
+			Epoch::enter();
+		}
+
+		EpochGuard(const EpochGuard&) {
+			Epoch::enter();
+		}
+
+		EpochGuard& operator=(const EpochGuard&) {
+			return *this;
+		}
+
+		~EpochGuard() {
+			Epoch::exit();
+		}
+	};
+}
+
+#endif //COROUTINELIB_CC_EPOCH_H
@@ -0,0 +1,612 @@
+#ifndef COROUTINELIB_CC_FLAT_DICTIONARY_H
+#define COROUTINELIB_CC_FLAT_DICTIONARY_H
+
+#include <memory>
+#include <optional>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <bit>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include "cc_epoch.h"
+#include "cc_dictionary.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CRLIB_FLAT_DICTIONARY_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace crlib {
+	namespace internal {
+		constexpr size_t flat_group_size = 16;
+		constexpr uint8_t flat_ctrl_empty = 0x80;
+		constexpr uint8_t flat_ctrl_deleted = 0xFE;
+		constexpr uint64_t flat_ctrl_all_empty = 0x8080808080808080ULL;
+
+		// Bit i is set when control byte i of the group equals 'value'
+		inline uint32_t flat_match(uint64_t lo, uint64_t hi, uint8_t value) {
+#if defined(CRLIB_FLAT_DICTIONARY_SSE2)
+			auto ctrl = _mm_set_epi64x(static_cast<long long>(hi), static_cast<long long>(lo));
+			return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(static_cast<char>(value)))));
+#else
+			uint32_t mask = 0;
+			for (size_t i = 0; i < flat_group_size; i++) {
+				auto byte = static_cast<uint8_t>((i < 8 ? lo >> (i * 8) : hi >> ((i - 8) * 8)) & 0xFF);
+				if (byte == value) {
+					mask |= 1U << i;
+				}
+			}
+			return mask;
+#endif
+		}
+
+		inline void flat_relax() {
+#if defined(CRLIB_FLAT_DICTIONARY_SSE2)
+			_mm_pause();
+#else
+			std::this_thread::yield();
+#endif
+		}
+
+		template<typename K, typename V>
+		constexpr bool flat_inline_storage = std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V> &&
+				std::is_default_constructible_v<K> && std::is_default_constructible_v<V> && sizeof(K) + sizeof(V) <= 32;
+
+		template<typename K, typename V, bool Inline = flat_inline_storage<K, V>>
+		struct FlatSlot;
+
+		/*
+		 * Small trivially copyable keys and values are stored in the slot itself, as atomic words:
+		 * readers may copy a slot while it is being written, the group seqlock tells them to retry.
+		 */
+		template<typename K, typename V>
+		struct FlatSlot<K, V, true> {
+			static constexpr size_t key_words = (sizeof(K) + 7) / 8;
+			static constexpr size_t value_words = (sizeof(V) + 7) / 8;
+
+			std::atomic<uint64_t> words[key_words + value_words];
+
+			K key() const {
+				uint64_t buffer[key_words];
+				for (size_t i = 0; i < key_words; i++) {
+					buffer[i] = words[i].load(std::memory_order_relaxed);
+				}
+				K k;
+				std::memcpy(&k, buffer, sizeof(K));
+				return k;
+			}
+
+			V value() const {
+				uint64_t buffer[value_words];
+				for (size_t i = 0; i < value_words; i++) {
+					buffer[i] = words[key_words + i].load(std::memory_order_relaxed);
+				}
+				V v;
+				std::memcpy(&v, buffer, sizeof(V));
+				return v;
+			}
+
+			bool holds(const K& k) const {
+				return key() == k;
+			}
+
+			bool read(const K& k, std::optional<V>& out) const {
+				if (!(key() == k)) {
+					return false;
+				}
+				out = value();
+				return true;
+			}
+
+			std::optional<std::pair<K, V>> pair() const {
+				return std::pair<K, V>(key(), value());
+			}
+
+			void write(const K& k, const V& v) {
+				uint64_t buffer[key_words] = {};
+				std::memcpy(buffer, &k, sizeof(K));
+				for (size_t i = 0; i < key_words; i++) {
+					words[i].store(buffer[i], std::memory_order_relaxed);
+				}
+				update(v);
+			}
+
+			void update(const V& v) {
+				uint64_t buffer[value_words] = {};
+				std::memcpy(buffer, &v, sizeof(V));
+				for (size_t i = 0; i < value_words; i++) {
+					words[key_words + i].store(buffer[i], std::memory_order_relaxed);
+				}
+			}
+
+			void erase() {
+
+			}
+
+			void move_from(FlatSlot& other) {
+				for (size_t i = 0; i < key_words + value_words; i++) {
+					words[i].store(other.words[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+				}
+			}
+
+			void destroy() {
+
+			}
+		};
+
+		/*
+		 * Other types live in an immutable heap node, replaced on update and reclaimed through Epoch.
+		 */
+		template<typename K, typename V>
+		struct FlatSlot<K, V, false> {
+			struct Node {
+				const K key;
+				const V value;
+			};
+
+			std::atomic<Node*> node;
+
+			K key() const {
+				return node.load(std::memory_order_acquire)->key;
+			}
+
+			bool holds(const K& k) const {
+				auto n = node.load(std::memory_order_acquire);
+				return n != nullptr && n->key == k;
+			}
+
+			bool read(const K& k, std::optional<V>& out) const {
+				auto n = node.load(std::memory_order_acquire);
+				if (n == nullptr || !(n->key == k)) {
+					return false;
+				}
+				out = n->value;
+				return true;
+			}
+
+			std::optional<std::pair<K, V>> pair() const {
+				auto n = node.load(std::memory_order_acquire);
+				if (n == nullptr) {
+					return std::nullopt;
+				}
+				return std::pair<K, V>(n->key, n->value);
+			}
+
+			void write(const K& k, const V& v) {
+				node.store(new Node{k, v}, std::memory_order_release);
+			}
+
+			void update(const V& v) {
+				auto old = node.load(std::memory_order_relaxed);
+				node.store(new Node{old->key, v}, std::memory_order_release);
+				Epoch::retire(old);
+			}
+
+			void erase() {
+				auto old = node.exchange(nullptr, std::memory_order_acq_rel);
+				if (old != nullptr) {
+					Epoch::retire(old);
+				}
+			}
+
+			// Used while resizing: the node is shared with the old table until that is reclaimed
+			void move_from(FlatSlot& other) {
+				node.store(other.node.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			}
+
+			void destroy() {
+				delete node.exchange(nullptr, std::memory_order_relaxed);
+			}
+		};
+	}
+
+	/*
+	 * Open addressing hash map in the Swiss table style, with the same get/set/erase/iteration API as ConcurrentDictionary.
+	 * Slots are arranged in groups of 16, each with 16 control bytes (empty, deleted, or 7 bits of the key hash):
+	 * a lookup compares the control bytes of a whole group at once with SSE2, then only looks at the slots that match,
+	 * usually touching the control bytes and one slot.
+	 * Readers never lock: every group has a sequence counter, odd while a writer is modifying it, which readers use to
+	 * validate what they read. Writers lock a stripe selected by the key hash, then the group they modify.
+	 * Growing the table (or purging deleted slots) takes every stripe lock: writers wait, readers keep using the old table.
+	 * Iterators hold an EpochGuard: they must not be kept across a co_await.
+	 */
+	template<typename K, typename V>
+	class ConcurrentFlatDictionary {
+	protected:
+		using slot_t = internal::FlatSlot<K, V>;
+
+		struct Group {
+			std::atomic<uint32_t> seq;
+			std::atomic<uint64_t> ctrl[2];
+			slot_t slots[internal::flat_group_size];
+
+			Group() : seq(0) {
+				ctrl[0].store(internal::flat_ctrl_all_empty, std::memory_order_relaxed);
+				ctrl[1].store(internal::flat_ctrl_all_empty, std::memory_order_relaxed);
+			}
+
+			uint8_t ctrl_at(size_t i) const {
+				return static_cast<uint8_t>(ctrl[i / 8].load(std::memory_order_relaxed) >> ((i % 8) * 8));
+			}
+
+			// Must hold the group lock
+			void set_ctrl(size_t i, uint8_t value) {
+				auto& word = ctrl[i / 8];
+				auto shift = (i % 8) * 8;
+				auto old = word.load(std::memory_order_relaxed);
+				word.store((old & ~(0xFFULL << shift)) | (static_cast<uint64_t>(value) << shift), std::memory_order_relaxed);
+			}
+
+			void lock() {
+				auto s = seq.load(std::memory_order_relaxed);
+				while ((s & 1) != 0 || !seq.compare_exchange_weak(s, s + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+					internal::flat_relax();
+					s = seq.load(std::memory_order_relaxed);
+				}
+				// Keeps the relaxed ctrl and slot stores that follow from becoming visible before the odd seq: pairs with
+				// the fence in validate()
+				std::atomic_thread_fence(std::memory_order_release);
+			}
+
+			void unlock() {
+				seq.fetch_add(1, std::memory_order_release);
+			}
+
+			// Consistent snapshot of the control bytes. Returns the sequence number to validate the following reads with
+			uint32_t read_ctrl(uint64_t& lo, uint64_t& hi) const {
+				while (true) {
+					auto s = seq.load(std::memory_order_acquire);
+					if ((s & 1) == 0) {
+						lo = ctrl[0].load(std::memory_order_relaxed);
+						hi = ctrl[1].load(std::memory_order_relaxed);
+						return s;
+					}
+					internal::flat_relax();
+				}
+			}
+
+			bool validate(uint32_t s) const {
+				std::atomic_thread_fence(std::memory_order_acquire);
+				return seq.load(std::memory_order_relaxed) == s;
+			}
+		};
+
+		struct Table {
+			const size_t group_mask;
+			std::unique_ptr<Group[]> groups;
+			std::atomic<size_t> occupied;
+
+			explicit Table(size_t group_count) : group_mask(group_count - 1), groups(new Group[group_count]), occupied(0) {
+
+			}
+
+			size_t capacity() const {
+				return (group_mask + 1) * internal::flat_group_size;
+			}
+		};
+
+		static constexpr size_t stripe_count = 64;
+
+		std::atomic<Table*> table;
+		std::vector<std::mutex> locks;
+		std::atomic<size_t> count;
+
+		static size_t hash_of(const K& key) {
+			return internal::mix_hash(static_cast<size_t>(std::hash<K>()(key)));
+		}
+
+		static uint8_t h2(size_t hash) {
+			return static_cast<uint8_t>(hash & 0x7F);
+		}
+
+		std::mutex& stripe(size_t hash) {
+			return locks[(hash >> 7) & (stripe_count - 1)];
+		}
+
+		// Must hold the stripe lock of 'hash', so the slot holding the key cannot change
+		std::pair<Group*, size_t> find_slot(Table* t, const K& key, size_t hash) {
+			auto g = (hash >> 7) & t->group_mask;
+			for (size_t step = 0; step <= t->group_mask; step++) {
+				auto& group = t->groups[g];
+				uint64_t lo, hi;
+				group.read_ctrl(lo, hi);
+
+				auto match = internal::flat_match(lo, hi, h2(hash));
+				while (match != 0) {
+					auto i = static_cast<size_t>(std::countr_zero(match));
+					match &= match - 1;
+					if (group.slots[i].holds(key)) {
+						return {&group, i};
+					}
+				}
+
+				if (internal::flat_match(lo, hi, internal::flat_ctrl_empty) != 0) {
+					break;
+				}
+				g = (g + step + 1) & t->group_mask;
+			}
+			return {nullptr, 0};
+		}
+
+		// Places an entry of a table nobody else can see yet
+		static void insert_unlocked(Table* t, size_t hash, slot_t& source) {
+			auto g = (hash >> 7) & t->group_mask;
+			for (size_t step = 0; step <= t->group_mask; step++) {
+				auto& group = t->groups[g];
+				auto free = internal::flat_match(group.ctrl[0].load(std::memory_order_relaxed), group.ctrl[1].load(std::memory_order_relaxed), internal::flat_ctrl_empty);
+				if (free != 0) {
+					auto i = static_cast<size_t>(std::countr_zero(free));
+					group.slots[i].move_from(source);
+					group.set_ctrl(i, h2(hash));
+					t->occupied.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				g = (g + step + 1) & t->group_mask;
+			}
+		}
+
+		void resize(Table* t) {
+			std::vector<std::unique_lock<std::mutex>> held;
+			held.reserve(locks.size());
+			for (auto& l : locks) {
+				held.emplace_back(l);
+			}
+
+			if (table.load(std::memory_order_acquire) != t) {
+				return;
+			}
+
+			// Grow when at least half the slots are live, otherwise just get rid of the deleted ones
+			auto groups = t->group_mask + 1;
+			if (count.load(std::memory_order_relaxed) * 2 >= t->capacity()) {
+				groups *= 2;
+			}
+
+			auto nt = new Table(groups);
+			for (size_t g = 0; g <= t->group_mask; g++) {
+				auto& group = t->groups[g];
+				for (size_t i = 0; i < internal::flat_group_size; i++) {
+					auto c = group.ctrl_at(i);
+					if (c != internal::flat_ctrl_empty && c != internal::flat_ctrl_deleted) {
+						insert_unlocked(nt, hash_of(group.slots[i].key()), group.slots[i]);
+					}
+				}
+			}
+
+			table.store(nt, std::memory_order_release);
+			Epoch::retire(t);
+		}
+
+		bool over_load_factor(Table* t) const {
+			return t->occupied.load(std::memory_order_relaxed) * 8 > t->capacity() * 7;
+		}
+
+	public:
+
+		struct Iterator {
+		private:
+			EpochGuard guard;
+			Table* t = nullptr;
+			size_t position = 0;
+			std::optional<std::pair<K, V>> current;
+
+			void advance() {
+				while (t != nullptr) {
+					if (position >= t->capacity()) {
+						t = nullptr;
+						position = 0;
+						current.reset();
+						return;
+					}
+
+					auto& group = t->groups[position / internal::flat_group_size];
+					auto i = position % internal::flat_group_size;
+					uint64_t lo, hi;
+					auto s = group.read_ctrl(lo, hi);
+					auto c = static_cast<uint8_t>((i < 8 ? lo >> (i * 8) : hi >> ((i - 8) * 8)) & 0xFF);
+					if (c == internal::flat_ctrl_empty || c == internal::flat_ctrl_deleted) {
+						position++;
+						continue;
+					}
+
+					auto value = group.slots[i].pair();
+					if (!group.validate(s)) {
+						continue;
+					}
+
+					if (value.has_value()) {
+						current = std::move(value);
+						return;
+					}
+					position++;
+				}
+			}
+
+		public:
+			using iterator_category = std::input_iterator_tag;
+			using value_type = std::pair<K, V>;
+
+			Iterator() = default;
+			explicit Iterator(Table* t) : t(t), position(0) {
+				advance();
+			}
+
+			value_type operator*() const {
+				return current.value();
+			}
+
+			Iterator& operator++() {
+				position++;
+				advance();
+				return *this;
+			}
+
+			friend bool operator!= (const Iterator& a, const Iterator& b) {
+				return a.t != b.t || a.position != b.position;
+			}
+		};
+
+		explicit ConcurrentFlatDictionary(size_t initial_capacity = 64) :
+				table(new Table(internal::next_power_of_two(std::max<size_t>((initial_capacity + internal::flat_group_size - 1) / internal::flat_group_size, 1)))),
+				locks(stripe_count),
+				count(0) {
+		}
+
+		ConcurrentFlatDictionary(const ConcurrentFlatDictionary&) = delete;
+		ConcurrentFlatDictionary& operator=(const ConcurrentFlatDictionary&) = delete;
+
+		~ConcurrentFlatDictionary() {
+			auto t = table.load(std::memory_order_acquire);
+			for (size_t g = 0; g <= t->group_mask; g++) {
+				auto& group = t->groups[g];
+				for (size_t i = 0; i < internal::flat_group_size; i++) {
+					auto c = group.ctrl_at(i);
+					if (c != internal::flat_ctrl_empty && c != internal::flat_ctrl_deleted) {
+						group.slots[i].destroy();
+					}
+				}
+			}
+			delete t;
+		}
+
+		Iterator begin() {
+			EpochGuard g;
+			return Iterator(table.load(std::memory_order_acquire));
+		}
+
+		Iterator end() {
+			return Iterator();
+		}
+
+		[[nodiscard]] size_t size() const {
+			return count.load(std::memory_order_relaxed);
+		}
+
+		void set(const K& key, const V& val) {
+			auto hash = hash_of(key);
+			EpochGuard guard;
+
+			while (true) {
+				Table* t;
+				bool inserted = false;
+				{
+					std::lock_guard lock(stripe(hash));
+					t = table.load(std::memory_order_acquire);
+
+					auto [found, idx] = find_slot(t, key, hash);
+					if (found != nullptr) {
+						found->lock();
+						found->slots[idx].update(val);
+						found->unlock();
+						return;
+					}
+
+					auto g = (hash >> 7) & t->group_mask;
+					for (size_t step = 0; step <= t->group_mask && !inserted; step++) {
+						auto& group = t->groups[g];
+						group.lock();
+						auto lo = group.ctrl[0].load(std::memory_order_relaxed);
+						auto hi = group.ctrl[1].load(std::memory_order_relaxed);
+						auto empty = internal::flat_match(lo, hi, internal::flat_ctrl_empty);
+						auto free = empty | internal::flat_match(lo, hi, internal::flat_ctrl_deleted);
+						if (free != 0) {
+							auto i = static_cast<size_t>(std::countr_zero(free));
+							group.slots[i].write(key, val);
+							group.set_ctrl(i, h2(hash));
+							if ((empty & (1U << i)) != 0) {
+								t->occupied.fetch_add(1, std::memory_order_relaxed);
+							}
+							inserted = true;
+						}
+						group.unlock();
+						g = (g + step + 1) & t->group_mask;
+					}
+
+					if (inserted) {
+						count.fetch_add(1, std::memory_order_relaxed);
+					}
+				}
+
+				if (!inserted || over_load_factor(t)) {
+					resize(t);
+				}
+				if (inserted) {
+					return;
+				}
+			}
+		}
+
+		bool erase(const K& key) {
+			auto hash = hash_of(key);
+			EpochGuard guard;
+			std::lock_guard lock(stripe(hash));
+			auto t = table.load(std::memory_order_acquire);
+
+			auto [found, idx] = find_slot(t, key, hash);
+			if (found == nullptr) {
+				return false;
+			}
+
+			found->lock();
+			found->slots[idx].erase();
+			// Probes stop at a group with an empty slot anyway, the slot can be marked empty instead of deleted
+			auto lo = found->ctrl[0].load(std::memory_order_relaxed);
+			auto hi = found->ctrl[1].load(std::memory_order_relaxed);
+			if (internal::flat_match(lo, hi, internal::flat_ctrl_empty) != 0) {
+				found->set_ctrl(idx, internal::flat_ctrl_empty);
+				t->occupied.fetch_sub(1, std::memory_order_relaxed);
+			} else {
+				found->set_ctrl(idx, internal::flat_ctrl_deleted);
+			}
+			found->unlock();
+
+			count.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		std::optional<V> get(const K& key) {
+			auto hash = hash_of(key);
+			EpochGuard guard;
+			auto t = table.load(std::memory_order_acquire);
+
+			auto g = (hash >> 7) & t->group_mask;
+			for (size_t step = 0; step <= t->group_mask; step++) {
+				auto& group = t->groups[g];
+				while (true) {
+					uint64_t lo, hi;
+					auto s = group.read_ctrl(lo, hi);
+
+					std::optional<V> result;
+					auto match = internal::flat_match(lo, hi, h2(hash));
+					while (match != 0) {
+						auto i = static_cast<size_t>(std::countr_zero(match));
+						match &= match - 1;
+						if (group.slots[i].read(key, result)) {
+							break;
+						}
+					}
+					auto has_empty = internal::flat_match(lo, hi, internal::flat_ctrl_empty) != 0;
+
+					if (!group.validate(s)) {
+						continue;
+					}
+					if (result.has_value()) {
+						return result;
+					}
+					if (has_empty) {
+						return std::nullopt;
+					}
+					break;
+				}
+				g = (g + step + 1) & t->group_mask;
+			}
+
+			return std::nullopt;
+		}
+	};
+}
+
+#endif //COROUTINELIB_CC_FLAT_DICTIONARY_H
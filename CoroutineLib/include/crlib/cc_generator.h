@@ -0,0 +1,161 @@
+#ifndef COROUTINELIB_CC_GENERATOR_H
+#define COROUTINELIB_CC_GENERATOR_H
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <type_traits>
+
+namespace crlib {
+	template<typename T>
+	struct Generator;
+
+	/*
+	 * Promise of a synchronous Generator<T>. The yielded value is not copied: the promise keeps a pointer to it,
+	 * which stays valid while the generator is suspended at the co_yield.
+	 */
+	template<typename T>
+	struct Generator_Promise {
+		using ValueType = std::remove_cvref_t<T>;
+
+		const ValueType* current = nullptr;
+		std::exception_ptr exception;
+
+		Generator<T> get_return_object() noexcept;
+
+		std::suspend_always initial_suspend() const noexcept {
+			return {};
+		}
+
+		std::suspend_always final_suspend() const noexcept {
+			return {};
+		}
+
+		std::suspend_always yield_value(const ValueType& value) noexcept {
+			current = std::addressof(value);
+			return {};
+		}
+
+		void return_void() const noexcept {
+
+		}
+
+		void unhandled_exception() noexcept {
+			exception = std::current_exception();
+		}
+
+		// A Generator is resumed inline by its consumer, there is nothing that could resume it after a co_await
+		template<typename U>
+		std::suspend_never await_transform(U&&) = delete;
+
+		void rethrow_if_exception() {
+			if (exception) {
+				std::rethrow_exception(std::exchange(exception, nullptr));
+			}
+		}
+	};
+
+	/*
+	 * Lazily computed sequence, resumed inline by the consumer through a range-for loop.
+	 * Unlike GeneratorTask, it never goes through a scheduler, and uses no locks, queues or std::function.
+	 */
+	template<typename T>
+	struct Generator {
+		using promise_type = Generator_Promise<T>;
+		using handle_type = std::coroutine_handle<promise_type>;
+		using ValueType = typename promise_type::ValueType;
+
+		struct Iterator {
+			using iterator_category = std::input_iterator_tag;
+			using difference_type = std::ptrdiff_t;
+			using value_type = ValueType;
+			using reference = const ValueType&;
+			using pointer = const ValueType*;
+
+			handle_type handle = nullptr;
+
+			Iterator() = default;
+			explicit Iterator(handle_type handle) : handle(handle) {
+
+			}
+
+			reference operator*() const {
+				return *handle.promise().current;
+			}
+
+			pointer operator->() const {
+				return handle.promise().current;
+			}
+
+			Iterator& operator++() {
+				handle.resume();
+				if (handle.done()) {
+					handle.promise().rethrow_if_exception();
+				}
+				return *this;
+			}
+
+			void operator++(int) {
+				++*this;
+			}
+
+			friend bool operator==(const Iterator& it, std::default_sentinel_t) noexcept {
+				return !it.handle || it.handle.done();
+			}
+		};
+
+		Generator() = delete;
+		explicit Generator(handle_type handle) noexcept : handle(handle) {
+
+		}
+
+		Generator(const Generator&) = delete;
+		Generator& operator=(const Generator&) = delete;
+
+		Generator(Generator&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {
+
+		}
+
+		Generator& operator=(Generator&& other) noexcept {
+			if (this != &other) {
+				if (handle) {
+					handle.destroy();
+				}
+				handle = std::exchange(other.handle, nullptr);
+			}
+			return *this;
+		}
+
+		~Generator() {
+			if (handle) {
+				handle.destroy();
+			}
+		}
+
+		Iterator begin() {
+			if (handle) {
+				handle.resume();
+				if (handle.done()) {
+					handle.promise().rethrow_if_exception();
+				}
+			}
+			return Iterator(handle);
+		}
+
+		std::default_sentinel_t end() const noexcept {
+			return std::default_sentinel;
+		}
+
+	private:
+		handle_type handle;
+	};
+
+	template<typename T>
+	Generator<T> Generator_Promise<T>::get_return_object() noexcept {
+		return Generator<T>(std::coroutine_handle<Generator_Promise<T>>::from_promise(*this));
+	}
+}
+
+#endif //COROUTINELIB_CC_GENERATOR_H
@@ -0,0 +1,279 @@
+#ifndef COROUTINELIB_CC_GENERATOR_ADAPTERS_H
+#define COROUTINELIB_CC_GENERATOR_ADAPTERS_H
+
+#include <optional>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+#include <functional>
+#include "cc_task_types.h"
+#include "cc_generator_task.h"
+
+namespace crlib {
+
+	/*
+	 * Adapters are bound to their input type when piped onto a GeneratorTask (or onto another pipeline),
+	 * producing a "stage". Every stage exposes:
+	 *  - push(value): feeds one input item, returns the item to emit (if any)
+	 *  - done(): true when no further input is needed
+	 *  - flush(): called repeatedly once the input is over, until it returns std::nullopt
+	 * Stages are composed inline, so the whole pipeline runs inside a single generator coroutine.
+	 */
+
+	template<typename In, typename F>
+	struct MapStage {
+		using InputType = In;
+		using OutputType = std::decay_t<std::invoke_result_t<F&, In&&>>;
+		F func;
+
+		std::optional<OutputType> push(In value) {
+			return std::invoke(func, std::move(value));
+		}
+
+		constexpr bool done() const {
+			return false;
+		}
+
+		std::optional<OutputType> flush() {
+			return std::nullopt;
+		}
+	};
+
+	template<typename In, typename P>
+	struct FilterStage {
+		using InputType = In;
+		using OutputType = In;
+		P predicate;
+
+		std::optional<OutputType> push(In value) {
+			if (std::invoke(predicate, std::as_const(value))) {
+				return std::move(value);
+			}
+			return std::nullopt;
+		}
+
+		constexpr bool done() const {
+			return false;
+		}
+
+		std::optional<OutputType> flush() {
+			return std::nullopt;
+		}
+	};
+
+	template<typename In>
+	struct TakeStage {
+		using InputType = In;
+		using OutputType = In;
+		size_t remaining;
+
+		std::optional<OutputType> push(In value) {
+			if (remaining == 0) {
+				return std::nullopt;
+			}
+			remaining--;
+			return std::move(value);
+		}
+
+		bool done() const {
+			return remaining == 0;
+		}
+
+		std::optional<OutputType> flush() {
+			return std::nullopt;
+		}
+	};
+
+	template<typename In>
+	struct ChunkStage {
+		using InputType = In;
+		using OutputType = std::vector<In>;
+		size_t size;
+		std::vector<In> buffer;
+
+		std::optional<OutputType> push(In value) {
+			if (buffer.capacity() < size) {
+				buffer.reserve(size);
+			}
+
+			buffer.push_back(std::move(value));
+			if (buffer.size() < size) {
+				return std::nullopt;
+			}
+			return std::exchange(buffer, {});
+		}
+
+		constexpr bool done() const {
+			return false;
+		}
+
+		std::optional<OutputType> flush() {
+			if (buffer.empty()) {
+				return std::nullopt;
+			}
+			return std::exchange(buffer, {});
+		}
+	};
+
+	template<typename First, typename Second>
+	struct ComposedStage {
+		using InputType = typename First::InputType;
+		using OutputType = typename Second::OutputType;
+		First first;
+		Second second;
+
+		std::optional<OutputType> push(InputType value) {
+			auto v = first.push(std::move(value));
+			if (!v.has_value()) {
+				return std::nullopt;
+			}
+			return second.push(std::move(v.value()));
+		}
+
+		bool done() const {
+			return first.done() || second.done();
+		}
+
+		std::optional<OutputType> flush() {
+			auto v = first.flush();
+			while (v.has_value()) {
+				auto out = second.push(std::move(v.value()));
+				if (out.has_value()) {
+					return out;
+				}
+				v = first.flush();
+			}
+			return second.flush();
+		}
+	};
+
+	template<typename F>
+	struct MapAdapter {
+		F func;
+
+		template<typename In>
+		MapStage<In, F> bind() const {
+			return {func};
+		}
+	};
+
+	template<typename P>
+	struct FilterAdapter {
+		P predicate;
+
+		template<typename In>
+		FilterStage<In, P> bind() const {
+			return {predicate};
+		}
+	};
+
+	struct TakeAdapter {
+		size_t count;
+
+		template<typename In>
+		TakeStage<In> bind() const {
+			return {count};
+		}
+	};
+
+	struct ChunkAdapter {
+		size_t size;
+
+		template<typename In>
+		ChunkStage<In> bind() const {
+			return {size, {}};
+		}
+	};
+
+	template<typename A, typename In>
+	concept GeneratorAdapter = requires(const A& adapter) {
+		adapter.template bind<In>();
+	};
+
+	template<typename F>
+	MapAdapter<std::decay_t<F>> map(F&& func) {
+		return {std::forward<F>(func)};
+	}
+
+	template<typename P>
+	FilterAdapter<std::decay_t<P>> filter(P&& predicate) {
+		return {std::forward<P>(predicate)};
+	}
+
+	inline TakeAdapter take(size_t count) {
+		return {count};
+	}
+
+	inline ChunkAdapter chunk(size_t size) {
+		if (size == 0) {
+			throw std::invalid_argument("Chunk size must be greater than zero");
+		}
+		return {size};
+	}
+
+	template<typename T, IsTaskScheduler Scheduler, typename Stage>
+	GeneratorTask<typename Stage::OutputType, Scheduler> run_fused_pipeline(GeneratorTask<T, Scheduler> source, Stage stage) {
+		// When a stage needs no more input, or the pipeline itself is stopped, the source would otherwise stay
+		// suspended at its co_yield forever. Stopping a source that completed has no effect.
+		struct SourceStopper {
+			GeneratorTask<T, Scheduler>& source;
+
+			~SourceStopper() {
+				source.stop();
+			}
+		} stopper{source};
+
+		while (!stage.done()) {
+			auto value = co_await source;
+			if (!value.has_value()) {
+				break;
+			}
+
+			auto out = stage.push(std::move(value.value()));
+			if (out.has_value()) {
+				co_yield std::move(out.value());
+			}
+		}
+
+		auto rest = stage.flush();
+		while (rest.has_value()) {
+			co_yield std::move(rest.value());
+			rest = stage.flush();
+		}
+	}
+
+	/*
+	 * Lazy chain of adapters over a GeneratorTask. Nothing runs until the pipeline is converted
+	 * to a GeneratorTask, which starts a single coroutine executing every stage. The pipeline owns its source:
+	 * once a stage needs no more input (see take()), the source is stopped.
+	 */
+	template<typename T, IsTaskScheduler Scheduler, typename Stage>
+	struct GeneratorPipeline {
+		using OutputType = typename Stage::OutputType;
+
+		GeneratorTask<T, Scheduler> source;
+		Stage stage;
+
+		operator GeneratorTask<OutputType, Scheduler>() && {
+			return run_fused_pipeline<T, Scheduler, Stage>(std::move(source), std::move(stage));
+		}
+	};
+
+	template<typename T, IsTaskScheduler Scheduler, GeneratorAdapter<T> Adapter>
+	auto operator|(GeneratorTask<T, Scheduler> source, const Adapter& adapter) {
+		using Stage = decltype(adapter.template bind<T>());
+		return GeneratorPipeline<T, Scheduler, Stage>{std::move(source), adapter.template bind<T>()};
+	}
+
+	template<typename T, IsTaskScheduler Scheduler, typename Stage, GeneratorAdapter<typename Stage::OutputType> Adapter>
+	auto operator|(GeneratorPipeline<T, Scheduler, Stage>&& pipeline, const Adapter& adapter) {
+		using Next = decltype(adapter.template bind<typename Stage::OutputType>());
+		return GeneratorPipeline<T, Scheduler, ComposedStage<Stage, Next>>{
+			std::move(pipeline.source),
+			ComposedStage<Stage, Next>{std::move(pipeline.stage), adapter.template bind<typename Stage::OutputType>()}
+		};
+	}
+}
+
+#endif //COROUTINELIB_CC_GENERATOR_ADAPTERS_H
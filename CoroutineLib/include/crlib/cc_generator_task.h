@@ -8,6 +8,12 @@
 #include "cc_logger.h"
 
 namespace crlib {
+	namespace internal {
+		// Thrown from the co_yield of a stopped generator, to unwind it
+		struct GeneratorStopped {
+		};
+	}
+
 	template<typename T>
 	struct GeneratorTask_Yielder {
 		std::shared_ptr<Generator_Lock_t<T>> lock;
@@ -22,27 +28,48 @@ namespace crlib {
 			return false;
 		}
 
+		// Returns false, to resume the generator right away, when a consumer was already waiting
 		template<typename PromiseType>
-		void await_suspend(std::coroutine_handle<PromiseType> h) {
+		bool await_suspend(std::coroutine_handle<PromiseType> h) {
+			// Once the waiter is published, the generator may be resumed and this yielder destroyed by a consumer
+			auto l = lock;
 			while(true) {
-				auto awaiter = lock->waiting_queue.pull();
+				auto awaiter = l->waiting_queue.pull();
 				if (awaiter.has_value()) {
 					auto func = awaiter.value();
 					func(val);
-					h();
-					return;
+					return false;
 				} else {
-					auto waiter = new std::function<void()>(std::move([this, h]() -> void {
+					auto waiter = new std::function<void()>(std::move([this, c = internal::Continuation<typename PromiseType::Scheduler>(h)]() -> void {
+						// Only runs once a consumer queued itself: the spin lasts until that consumer, or the one
+						// a late yielder puts back below, is visible in the queue
 						auto func = lock->waiting_queue.pull();
 						while(!func.has_value()) {
 							func = lock->waiting_queue.pull();
 						}
 						func.value()(val);
-						PromiseType::Scheduler::Schedule(h);
+						c.resume();
 					}));
 					std::function<void()>* f = nullptr;
-					if (lock->generator_waiter.compare_exchange_strong(f, waiter)) {
-						return;
+					if (l->generator_waiter.compare_exchange_strong(f, waiter)) {
+						// A consumer may have queued itself after the pull() above, and found no waiter to wake
+						auto late = l->waiting_queue.pull();
+						if (!late.has_value()) {
+							return true;
+						}
+
+						auto expected = waiter;
+						if (l->generator_waiter.compare_exchange_strong(expected, nullptr)) {
+							delete waiter;
+							late.value()(val);
+							return false;
+						}
+
+						// Another consumer is running the waiter, which spins until it finds a queued consumer.
+						// The late consumer goes back at the tail: consumers of a generator are served in no particular
+						// order, and the waiter is never left spinning longer than this push
+						l->waiting_queue.push(late.value());
+						return true;
 					}
 
 					delete waiter;
@@ -51,17 +78,25 @@ namespace crlib {
 		}
 
 		void await_resume() {
-
+			if (lock->stopping.load()) {
+				throw internal::GeneratorStopped();
+			}
 		}
 	};
 }
 
 
-template<typename T, typename ... Args>
-struct std::coroutine_traits<crlib::GeneratorTask<T>, Args...> {
-struct promise_type : public crlib::BasePromise<crlib::GeneratorTask<T>, crlib::Generator_Lock_t<T>> {
-		crlib::GeneratorTask_Yielder<T> yield_value(T val) {
-			return {this->lock, val};
+template<typename T, typename ... Args, typename Scheduler>
+struct std::coroutine_traits<crlib::GeneratorTask<T, Scheduler>, Args...> {
+struct promise_type : public crlib::BasePromise<crlib::GeneratorTask<T, Scheduler>, crlib::Generator_Lock_t<T>> {
+#ifdef CRLIB_INSPECTOR
+		promise_type(std::source_location location = std::source_location::current()) : promise_type::BasePromise(location) {
+
+		}
+#endif
+
+		crlib::internal::Inspected<crlib::GeneratorTask_Yielder<T>> yield_value(T val) {
+			return this->template inspected<crlib::GeneratorTask_Yielder<T>>(this->lock, std::move(val));
 		}
 
 		void return_void() {
@@ -0,0 +1,150 @@
+#ifndef COROUTINELIB_CC_HISTOGRAM_H
+#define COROUTINELIB_CC_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <limits>
+
+namespace crlib {
+	/*
+	 * HDR-style histogram of non-negative values, typically latencies in nanoseconds.
+	 * Values below 128 are counted exactly; larger values fall into 64 buckets per power of two, so every value is
+	 * known to within 1/64 (about 1.6%) of itself, over the whole 64 bit range, in a fixed 30KB of counters.
+	 * record() is a relaxed atomic increment, safe to call from any number of threads.
+	 */
+	class LatencyHistogram {
+	public:
+		static constexpr unsigned sub_bucket_bits = 7;
+		static constexpr uint64_t sub_bucket_count = uint64_t(1) << sub_bucket_bits;
+		static constexpr uint64_t sub_bucket_half = sub_bucket_count / 2;
+		static constexpr size_t bucket_count = sub_bucket_count + (64 - sub_bucket_bits) * sub_bucket_half;
+
+	protected:
+		std::array<std::atomic<uint64_t>, bucket_count> counts;
+		std::atomic<uint64_t> total;
+		std::atomic<uint64_t> sum;
+		std::atomic<uint64_t> minimum;
+		std::atomic<uint64_t> maximum;
+
+		static size_t index_of(uint64_t value) {
+			if (value < sub_bucket_count) {
+				return static_cast<size_t>(value);
+			}
+			auto shift = static_cast<unsigned>(std::bit_width(value)) - sub_bucket_bits;
+			auto sub = value >> shift;
+			return static_cast<size_t>(sub_bucket_count + (shift - 1) * sub_bucket_half + (sub - sub_bucket_half));
+		}
+
+		// Largest value that falls into the bucket at index
+		static uint64_t highest_of(size_t index) {
+			if (index < sub_bucket_count) {
+				return index;
+			}
+			auto shift = static_cast<unsigned>((index - sub_bucket_count) / sub_bucket_half) + 1;
+			auto sub = (index - sub_bucket_count) % sub_bucket_half + sub_bucket_half;
+			auto next = static_cast<uint64_t>(sub + 1) << shift;
+			return next == 0 ? std::numeric_limits<uint64_t>::max() : next - 1;
+		}
+
+	public:
+		LatencyHistogram() {
+			reset();
+		}
+
+		LatencyHistogram(const LatencyHistogram&) = delete;
+		LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+		void record(uint64_t value) {
+			counts[index_of(value)].fetch_add(1, std::memory_order_relaxed);
+			total.fetch_add(1, std::memory_order_relaxed);
+			sum.fetch_add(value, std::memory_order_relaxed);
+
+			auto m = minimum.load(std::memory_order_relaxed);
+			while (value < m && !minimum.compare_exchange_weak(m, value, std::memory_order_relaxed)) {
+
+			}
+			m = maximum.load(std::memory_order_relaxed);
+			while (value > m && !maximum.compare_exchange_weak(m, value, std::memory_order_relaxed)) {
+
+			}
+		}
+
+		// Adds the values recorded by other, which should not be recording at the same time
+		void merge(const LatencyHistogram& other) {
+			for (size_t i = 0; i < bucket_count; i++) {
+				auto c = other.counts[i].load(std::memory_order_relaxed);
+				if (c != 0) {
+					counts[i].fetch_add(c, std::memory_order_relaxed);
+				}
+			}
+			total.fetch_add(other.total.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			sum.fetch_add(other.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+			auto other_min = other.minimum.load(std::memory_order_relaxed);
+			auto m = minimum.load(std::memory_order_relaxed);
+			while (other_min < m && !minimum.compare_exchange_weak(m, other_min, std::memory_order_relaxed)) {
+
+			}
+			auto other_max = other.maximum.load(std::memory_order_relaxed);
+			m = maximum.load(std::memory_order_relaxed);
+			while (other_max > m && !maximum.compare_exchange_weak(m, other_max, std::memory_order_relaxed)) {
+
+			}
+		}
+
+		void reset() {
+			for (auto& c : counts) {
+				c.store(0, std::memory_order_relaxed);
+			}
+			total.store(0, std::memory_order_relaxed);
+			sum.store(0, std::memory_order_relaxed);
+			minimum.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+			maximum.store(0, std::memory_order_relaxed);
+		}
+
+		[[nodiscard]] uint64_t count() const {
+			return total.load(std::memory_order_relaxed);
+		}
+
+		[[nodiscard]] uint64_t min() const {
+			return count() == 0 ? 0 : minimum.load(std::memory_order_relaxed);
+		}
+
+		[[nodiscard]] uint64_t max() const {
+			return maximum.load(std::memory_order_relaxed);
+		}
+
+		[[nodiscard]] double mean() const {
+			auto c = count();
+			return c == 0 ? 0.0 : static_cast<double>(sum.load(std::memory_order_relaxed)) / static_cast<double>(c);
+		}
+
+		// Smallest recorded value such that percentile% of the values are lower or equal, within the bucket precision
+		[[nodiscard]] uint64_t percentile(double percentile) const {
+			uint64_t recorded = 0;
+			for (size_t i = 0; i < bucket_count; i++) {
+				recorded += counts[i].load(std::memory_order_relaxed);
+			}
+			if (recorded == 0) {
+				return 0;
+			}
+
+			auto rank = static_cast<uint64_t>(std::clamp(percentile, 0.0, 100.0) / 100.0 * static_cast<double>(recorded) + 0.5);
+			rank = std::clamp<uint64_t>(rank, 1, recorded);
+
+			uint64_t seen = 0;
+			for (size_t i = 0; i < bucket_count; i++) {
+				seen += counts[i].load(std::memory_order_relaxed);
+				if (seen >= rank) {
+					return std::max(std::min(highest_of(i), max()), min());
+				}
+			}
+			return max();
+		}
+	};
+}
+
+#endif //COROUTINELIB_CC_HISTOGRAM_H
@@ -0,0 +1,164 @@
+#ifndef COROUTINELIB_CC_INSPECTOR_H
+#define COROUTINELIB_CC_INSPECTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <source_location>
+#include <string>
+#include <utility>
+#include <vector>
+#include "cc_api.h"
+
+namespace crlib {
+	enum class TaskState : uint8_t {
+		// Waiting for the scheduler to start it
+		Scheduled,
+		Running,
+		// Waiting for the awaited object, or for the scheduler to resume it
+		Suspended
+	};
+
+	struct TaskSnapshot {
+		// Address of the coroutine frame, null if the task never suspended yet
+		const void* frame;
+		const void* lock;
+		std::source_location location;
+		TaskState state;
+		std::chrono::nanoseconds time_in_state;
+		// Type and address of what a suspended task is awaiting
+		std::string awaiting_type;
+		const void* awaiting;
+		// Index of the task awaiting this one
+		std::optional<size_t> awaited_by;
+	};
+
+	/*
+	 * Registry of live coroutine frames, compiled in by defining CRLIB_INSPECTOR (the CRLIB_INSPECTOR CMake option).
+	 * Every Task, ValueTask and GeneratorTask records where it was created, its state, since when it is in that state,
+	 * and what it is awaiting. Tasks awaiting other tasks form async stacks, which dump() prints from the innermost task
+	 * outwards. Without CRLIB_INSPECTOR, promises and awaiters are unchanged and snapshot() is always empty.
+	 */
+	struct Inspector {
+		CRLIB_API static std::vector<TaskSnapshot> snapshot();
+		CRLIB_API static size_t live_tasks();
+		CRLIB_API static void dump(std::ostream& out);
+		// Dumps to std::cerr whenever the process receives signal, from a background thread
+		CRLIB_API static void dump_on_signal(int signal);
+	};
+
+	namespace internal {
+		struct InspectorFrame {
+			const std::source_location location;
+			const void* const lock;
+			std::atomic<void*> frame;
+			std::atomic<TaskState> state;
+			// steady_clock ticks
+			std::atomic<int64_t> since;
+			std::atomic<const char*> awaiting_type;
+			std::atomic<const void*> awaiting;
+
+			// Owned by the registry
+			InspectorFrame* previous = nullptr;
+			InspectorFrame* next = nullptr;
+
+			CRLIB_API InspectorFrame(std::source_location location, const void* lock);
+			CRLIB_API ~InspectorFrame();
+
+			InspectorFrame(const InspectorFrame&) = delete;
+			InspectorFrame& operator=(const InspectorFrame&) = delete;
+
+			void set_state(TaskState s, const char* type = nullptr, const void* object = nullptr) {
+				awaiting_type.store(type, std::memory_order_relaxed);
+				awaiting.store(object, std::memory_order_relaxed);
+				since.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+				state.store(s, std::memory_order_release);
+			}
+		};
+
+		// The compiler spells out A in the name of this function, the inspector extracts it when taking a snapshot
+		template<typename A>
+		const char* awaiter_type_name() {
+			return std::source_location::current().function_name();
+		}
+
+		template<typename A>
+		const void* awaited_object(const A& a) {
+			if constexpr (requires { a.lock.get(); }) {
+				return a.lock.get();
+			} else if constexpr (requires { a.ctrl_block.get(); }) {
+				return a.ctrl_block.get();
+			} else if constexpr (requires { static_cast<const void*>(a.mutex); }) {
+				return a.mutex;
+			} else if constexpr (requires { static_cast<const void*>(a.semaphore); }) {
+				return a.semaphore;
+			} else if constexpr (requires { static_cast<const void*>(a.event); }) {
+				return a.event;
+			} else if constexpr (requires { static_cast<const void*>(a.barrier); }) {
+				return a.barrier;
+			} else if constexpr (requires { static_cast<const void*>(a.cv); }) {
+				return a.cv;
+			} else {
+				return &a;
+			}
+		}
+
+		// Wraps the awaiters returned by promises, to update the task's state around each suspension
+		template<typename A>
+		struct InspectedAwaiter {
+			A awaiter;
+			InspectorFrame* frame;
+			TaskState suspended_state;
+
+			template<typename ... Args>
+			InspectedAwaiter(InspectorFrame& frame, TaskState suspended_state, Args&& ... args) : awaiter(std::forward<Args>(args)...),
+				frame(&frame), suspended_state(suspended_state) {
+
+			}
+
+			bool await_ready() {
+				return awaiter.await_ready();
+			}
+
+			template<typename PromiseType>
+			decltype(auto) await_suspend(std::coroutine_handle<PromiseType> h) {
+				frame->frame.store(h.address(), std::memory_order_relaxed);
+				if (suspended_state == TaskState::Suspended) {
+					frame->set_state(TaskState::Suspended, awaiter_type_name<A>(), awaited_object(awaiter));
+				} else {
+					frame->set_state(suspended_state);
+				}
+
+				// Once suspended, the task may be resumed (and destroyed) by another thread at any moment
+				if constexpr (std::same_as<decltype(awaiter.await_suspend(h)), bool>) {
+					auto suspended = awaiter.await_suspend(h);
+					if (!suspended) {
+						frame->set_state(TaskState::Running);
+					}
+					return suspended;
+				} else {
+					return awaiter.await_suspend(h);
+				}
+			}
+
+			decltype(auto) await_resume() {
+				frame->set_state(TaskState::Running);
+				return awaiter.await_resume();
+			}
+		};
+
+#ifdef CRLIB_INSPECTOR
+		template<typename A>
+		using Inspected = InspectedAwaiter<A>;
+#else
+		template<typename A>
+		using Inspected = A;
+#endif
+	}
+}
+
+#endif //COROUTINELIB_CC_INSPECTOR_H
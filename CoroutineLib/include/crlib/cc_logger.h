@@ -5,37 +5,146 @@
 #ifndef COROUTINELIB_CC_LOGGER_H
 #define COROUTINELIB_CC_LOGGER_H
 
-#include <thread>
-#if defined(_DEBUG) || defined(DEBUG)
-#include "cc_queue_config.h"
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <functional>
 #include <string>
-#include <iostream>
-#include <sstream>
+#include <type_traits>
+#include "cc_api.h"
 
-namespace crlib::internal {
+#ifndef CRLIB_LOG_BUFFER_SIZE
+#define CRLIB_LOG_BUFFER_SIZE 4096
+#endif
 
-	default_queue<std::string> log_values;
+namespace crlib {
+	namespace internal {
+		constexpr size_t log_max_args = 6;
 
-	inline void dump_logs() {
-		auto v = log_values.pull();
-		while(v.has_value()) {
-			std::cout << "[LOG]" << v.value() << std::endl;
+		enum class LogArgType : uint8_t {
+			Int,
+			UInt,
+			Bool,
+			Char,
+			Double,
+			String,
+			Pointer
+		};
 
-			v = log_values.pull();
+		// One per CC_LOG call site, with static storage
+		struct LogFormat {
+			const char* format;
+			const char* file;
+			int line;
+		};
+
+		struct LogRecord {
+			const LogFormat* format;
+			uint64_t timestamp;
+			uint8_t count;
+			LogArgType types[log_max_args];
+			uint64_t args[log_max_args];
+		};
+
+		template<typename T>
+		requires std::same_as<T, bool>
+		void encode_log_arg(T value, LogArgType& type, uint64_t& word) {
+			type = LogArgType::Bool;
+			word = value ? 1 : 0;
+		}
+
+		template<typename T>
+		requires std::same_as<T, char>
+		void encode_log_arg(T value, LogArgType& type, uint64_t& word) {
+			type = LogArgType::Char;
+			word = static_cast<unsigned char>(value);
+		}
+
+		template<std::signed_integral T>
+		requires (!std::same_as<T, char>)
+		void encode_log_arg(T value, LogArgType& type, uint64_t& word) {
+			type = LogArgType::Int;
+			word = static_cast<uint64_t>(static_cast<int64_t>(value));
+		}
+
+		template<std::unsigned_integral T>
+		requires (!std::same_as<T, bool> && !std::same_as<T, char>)
+		void encode_log_arg(T value, LogArgType& type, uint64_t& word) {
+			type = LogArgType::UInt;
+			word = static_cast<uint64_t>(value);
+		}
+
+		template<std::floating_point T>
+		void encode_log_arg(T value, LogArgType& type, uint64_t& word) {
+			type = LogArgType::Double;
+			word = std::bit_cast<uint64_t>(static_cast<double>(value));
+		}
+
+		template<typename T>
+		requires std::is_enum_v<T>
+		void encode_log_arg(T value, LogArgType& type, uint64_t& word) {
+			encode_log_arg(static_cast<std::underlying_type_t<T>>(value), type, word);
+		}
+
+		// Only the pointer is recorded: strings must outlive the next drain, string literals always do
+		inline void encode_log_arg(const char* value, LogArgType& type, uint64_t& word) {
+			type = LogArgType::String;
+			word = reinterpret_cast<uintptr_t>(value);
+		}
+
+		template<typename T>
+		requires (!std::same_as<std::remove_cv_t<T>, char>)
+		void encode_log_arg(T* value, LogArgType& type, uint64_t& word) {
+			type = LogArgType::Pointer;
+			word = reinterpret_cast<uintptr_t>(value);
 		}
 	}
+
+	/*
+	 * Binary logger, cheap enough to stay enabled in release builds.
+	 * CC_LOG("format with {} placeholders", args...) copies the call site and up to 6 scalar arguments into a fixed-size
+	 * record on the calling thread's own ring buffer: nothing is formatted or allocated there. When a ring is full, records are
+	 * dropped (and counted) instead of blocking. Records are formatted later, ordered by time, by flush() or by the
+	 * background thread started with start().
+	 */
+	struct Logger {
+		using Sink = std::function<void(const std::string&)>;
+
+		CRLIB_API static void write(const internal::LogRecord& record);
+		// The default sink prints lines to std::cout
+		CRLIB_API static void set_sink(Sink sink);
+		// Formats every pending record on the calling thread
+		CRLIB_API static void flush();
+		CRLIB_API static void start(std::chrono::milliseconds interval = std::chrono::milliseconds(10));
+		// Stops the background thread and flushes what is left
+		CRLIB_API static void stop();
+		CRLIB_API static uint64_t dropped();
+
+		template<typename ... Args>
+		requires (sizeof...(Args) <= internal::log_max_args)
+		static void log(const internal::LogFormat* format, Args ... args) {
+			internal::LogRecord record;
+			record.format = format;
+			record.timestamp = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+			record.count = sizeof...(Args);
+			[[maybe_unused]] size_t i = 0;
+			((internal::encode_log_arg(args, record.types[i], record.args[i]), i++), ...);
+			write(record);
+		}
+	};
 }
 
-#define CC_LOG(s) crlib::internal::log_values.push(s)
-#define CC_LOG2(s) { std::stringstream ss; ss << std::hex << "[" << CC_CTID() << "]" << std::dec << s; CC_LOG(ss.str()); }
-#define CC_CTID() std::this_thread::get_id()
-#define CC_LOGDUMP() crlib::internal::dump_logs()
+#ifndef CRLIB_NO_LOGGING
+#define CC_LOG(format, ...) do { \
+		static constexpr crlib::internal::LogFormat cc_log_format { format, __FILE__, __LINE__ }; \
+		crlib::Logger::log(&cc_log_format __VA_OPT__(,) __VA_ARGS__); \
+	} while (0)
+#define CC_LOGDUMP() crlib::Logger::flush()
 #else
-#define CC_LOG(s)
-#define CC_LOG2(s)
-#define CC_CTID()
+#define CC_LOG(format, ...)
 #define CC_LOGDUMP()
-#endif //_DEBUG || DEBUG
+#endif //CRLIB_NO_LOGGING
 
 
 #endif //COROUTINELIB_CC_LOGGER_H
@@ -0,0 +1,393 @@
+#ifndef COROUTINELIB_CC_PARALLEL_H
+#define COROUTINELIB_CC_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <ranges>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "cc_task.h"
+#include "cc_sync_utils.h"
+
+/*
+ * Data-parallel algorithms running on the ThreadPool.
+ * The input is cut in chunks of 'grain' elements (0 picks a grain from the input size and the hardware concurrency).
+ * Chunk ranges are split in halves recursively: each split forks the upper half as a new task and keeps the lower one,
+ * so idle workers steal large ranges first and every element is processed within a cache-friendly contiguous chunk.
+ * Splitting is adaptive: a range only splits a few times, enough for every thread to get some, unless another worker
+ * steals it, which allows it one more split. Busy workers walk their chunks in order, idle ones get finer ranges.
+ * Every algorithm returns a Task: co_await it from a coroutine, or call its wait() from synchronous code.
+ * Callbacks are invoked concurrently from multiple threads, and the range must outlive the returned task.
+ * When a callback throws, the remaining chunks are skipped and the first exception is rethrown by the task.
+ */
+namespace crlib {
+	namespace internal {
+		inline size_t parallel_grain(size_t size, size_t grain) {
+			if (grain > 0) {
+				return grain;
+			}
+			// Many chunks per thread: adaptive splitting only cuts ranges that far when workers run out of work
+			auto threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+			return std::max<size_t>(size / (threads * 16), 1);
+		}
+
+		// Splits of a range that nobody stole: enough for two ranges per thread
+		inline size_t parallel_split_depth() {
+			auto threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+			size_t depth = 1;
+			while ((size_t(1) << depth) < threads * 2) {
+				depth++;
+			}
+			return depth;
+		}
+
+		inline size_t parallel_chunk_count(size_t size, size_t grain) {
+			return (size + grain - 1) / grain;
+		}
+
+		struct ParallelState {
+			WaitGroup group;
+			std::atomic_bool failed;
+			std::mutex exception_mutex;
+			std::exception_ptr exception;
+
+			ParallelState() : failed(false) {
+
+			}
+
+			void fail(std::exception_ptr e) {
+				std::lock_guard lock(exception_mutex);
+				if (exception == nullptr) {
+					exception = std::move(e);
+				}
+				failed.store(true, std::memory_order_relaxed);
+			}
+		};
+
+		// forker is the thread that forked this range: running anywhere else means it was stolen
+		template<typename Body>
+		Task<> parallel_split(size_t first, size_t last, size_t depth, std::thread::id forker, std::shared_ptr<Body> body, std::shared_ptr<ParallelState> state) {
+			try {
+				auto self = std::this_thread::get_id();
+				if (self != forker) {
+					depth++;
+				}
+
+				while (last - first > 1 && depth > 0 && !state->failed.load(std::memory_order_relaxed)) {
+					auto middle = first + (last - first) / 2;
+					depth--;
+					state->group.add(1);
+					parallel_split(middle, last, depth, self, body, state);
+					last = middle;
+				}
+
+				for (auto chunk = first; chunk < last && !state->failed.load(std::memory_order_relaxed); chunk++) {
+					(*body)(chunk);
+				}
+			} catch (...) {
+				state->fail(std::current_exception());
+			}
+			state->group.done();
+			co_return;
+		}
+
+		template<typename Body>
+		Task<> parallel_run(size_t chunks, std::shared_ptr<Body> body) {
+			if (chunks == 0) {
+				co_return;
+			}
+			if (chunks == 1) {
+				(*body)(0);
+				co_return;
+			}
+
+			auto state = std::make_shared<ParallelState>();
+			state->group.add(1);
+			parallel_split(0, chunks, parallel_split_depth(), std::this_thread::get_id(), body, state);
+			co_await state->group.wait();
+
+			if (state->exception != nullptr) {
+				std::rethrow_exception(state->exception);
+			}
+		}
+
+		// Runs body(chunk) for every chunk in [0, chunks)
+		template<typename Body>
+		Task<> parallel_chunks(size_t chunks, Body body) {
+			return parallel_run(chunks, std::make_shared<Body>(std::move(body)));
+		}
+
+		// Passes are stored before being awaited: GCC destroys lambda temporaries of a co_await expression twice
+		template<typename It, typename T, typename Op>
+		Task<T> parallel_reduce(It first, size_t size, size_t grain, T init, Op op) {
+			auto chunks = parallel_chunk_count(size, grain);
+			auto partials = std::make_shared<std::vector<std::optional<T>>>(chunks);
+
+			auto pass = parallel_chunks(chunks, [first, size, grain, partials, op](size_t chunk) {
+				auto begin = chunk * grain;
+				auto end = std::min(begin + grain, size);
+				auto it = first + static_cast<std::iter_difference_t<It>>(begin);
+
+				T acc = *it;
+				for (auto i = begin + 1; i < end; i++) {
+					++it;
+					acc = op(std::move(acc), *it);
+				}
+				(*partials)[chunk] = std::move(acc);
+			});
+			co_await pass;
+
+			for (auto& p : *partials) {
+				init = op(std::move(init), std::move(p.value()));
+			}
+			co_return init;
+		}
+
+		template<typename It, typename OutIt, typename Op>
+		Task<> parallel_inclusive_scan(It first, size_t size, OutIt out, size_t grain, Op op) {
+			using T = std::iter_value_t<It>;
+			auto chunks = parallel_chunk_count(size, grain);
+			if (chunks <= 1) {
+				std::inclusive_scan(first, first + static_cast<std::iter_difference_t<It>>(size), out, op);
+				co_return;
+			}
+
+			// First pass: the total of every chunk but the last one
+			auto offsets = std::make_shared<std::vector<std::optional<T>>>(chunks);
+			auto totals = parallel_chunks(chunks - 1, [first, grain, offsets, op](size_t chunk) {
+				auto it = first + static_cast<std::iter_difference_t<It>>(chunk * grain);
+				T acc = *it;
+				for (size_t i = 1; i < grain; i++) {
+					++it;
+					acc = op(std::move(acc), *it);
+				}
+				(*offsets)[chunk + 1] = std::move(acc);
+			});
+			co_await totals;
+
+			// Turn the totals into the sum of everything before each chunk. Chunk c - 1 still starts from its own
+			// offset: it is copied, not moved
+			for (size_t c = 2; c < chunks; c++) {
+				(*offsets)[c] = op((*offsets)[c - 1].value(), std::move((*offsets)[c].value()));
+			}
+
+			// Second pass: scan every chunk starting from its offset
+			auto scan = parallel_chunks(chunks, [first, size, out, grain, offsets, op](size_t chunk) {
+				auto begin = chunk * grain;
+				auto end = std::min(begin + grain, size);
+				auto it = first + static_cast<std::iter_difference_t<It>>(begin);
+				auto dest = out + static_cast<std::iter_difference_t<OutIt>>(begin);
+
+				auto& offset = (*offsets)[chunk];
+				T acc = offset.has_value() ? op(offset.value(), *it) : T(*it);
+				*dest = acc;
+				for (auto i = begin + 1; i < end; i++) {
+					++it;
+					++dest;
+					acc = op(std::move(acc), *it);
+					*dest = acc;
+				}
+			});
+			co_await scan;
+		}
+
+		// Elements taken from a in the first k elements of the merge of the sorted runs a and b, a's first on ties
+		template<typename It, typename Comp>
+		size_t merge_split(It a, size_t a_size, It b, size_t b_size, size_t k, Comp comp) {
+			using Diff = std::iter_difference_t<It>;
+			auto low = k > b_size ? k - b_size : 0;
+			auto high = std::min(k, a_size);
+			while (low < high) {
+				auto i = low + (high - low) / 2;
+				// a[i] is merged before b[k - i - 1]: more of a is needed
+				if (!comp(*(b + static_cast<Diff>(k - i - 1)), *(a + static_cast<Diff>(i)))) {
+					low = i + 1;
+				} else {
+					high = i;
+				}
+			}
+			return low;
+		}
+
+		// Uninitialized storage for the other half of parallel_sort's merges, filled chunk by chunk
+		template<typename T>
+		struct SortBuffer {
+			T* data;
+			size_t size;
+			size_t grain;
+			std::vector<uint8_t> filled;
+
+			SortBuffer(size_t size, size_t grain) : data(std::allocator<T>().allocate(size)), size(size), grain(grain), filled(parallel_chunk_count(size, grain), 0) {
+
+			}
+
+			SortBuffer(const SortBuffer&) = delete;
+			SortBuffer& operator=(const SortBuffer&) = delete;
+
+			~SortBuffer() {
+				for (size_t chunk = 0; chunk < filled.size(); chunk++) {
+					if (filled[chunk]) {
+						std::destroy(data + chunk * grain, data + std::min((chunk + 1) * grain, size));
+					}
+				}
+				std::allocator<T>().deallocate(data, size);
+			}
+		};
+
+		/*
+		 * Sorts every chunk and moves it to a buffer, then merges runs pairwise from one side to the other, doubling
+		 * their width every round. Every round is cut in chunks of output: a first pass finds where each slice of the merge
+		 * starts in both runs, the second one merges them, so even the last merge of two halves is spread on every worker.
+		 */
+		template<typename It, typename Comp>
+		Task<> parallel_sort(It first, size_t size, size_t grain, Comp comp) {
+			using T = std::iter_value_t<It>;
+			using Diff = std::iter_difference_t<It>;
+			auto chunks = parallel_chunk_count(size, grain);
+			if (chunks <= 1) {
+				std::sort(first, first + static_cast<Diff>(size), comp);
+				co_return;
+			}
+
+			auto buffer = std::make_shared<SortBuffer<T>>(size, grain);
+			auto sort = parallel_chunks(chunks, [first, size, grain, buffer, comp](size_t chunk) {
+				auto begin = first + static_cast<Diff>(chunk * grain);
+				auto end = first + static_cast<Diff>(std::min((chunk + 1) * grain, size));
+				std::sort(begin, end, comp);
+				std::uninitialized_move(begin, end, buffer->data + chunk * grain);
+				buffer->filled[chunk] = 1;
+			});
+			co_await sort;
+
+			// Sorted runs are in the buffer, the range only holds moved-from elements
+			bool in_buffer = true;
+			// Where every chunk of output starts and ends in the first run of its pair
+			auto splits = std::make_shared<std::vector<std::pair<size_t, size_t>>>(chunks);
+			for (size_t width = grain; width < size; width *= 2) {
+				// Every split is found before any element is moved out of the runs
+				auto split = [size, grain, width, splits, comp](auto source) {
+					return [source, size, grain, width, splits, comp](size_t chunk) {
+						// Pairs of runs are a multiple of grain long: a chunk of output never crosses two pairs
+						auto begin = chunk * grain;
+						auto end = std::min(begin + grain, size);
+						auto pair = begin - begin % (width * 2);
+						auto middle = std::min(pair + width, size);
+						auto pair_end = std::min(middle + width, size);
+
+						auto a = source + static_cast<std::iter_difference_t<decltype(source)>>(pair);
+						auto b = source + static_cast<std::iter_difference_t<decltype(source)>>(middle);
+						(*splits)[chunk] = {
+							merge_split(a, middle - pair, b, pair_end - middle, begin - pair, comp),
+							merge_split(a, middle - pair, b, pair_end - middle, end - pair, comp)
+						};
+					};
+				};
+				auto merge = [size, grain, width, splits, comp](auto source, auto dest) {
+					return [source, dest, size, grain, width, splits, comp](size_t chunk) {
+						auto begin = chunk * grain;
+						auto end = std::min(begin + grain, size);
+						auto pair = begin - begin % (width * 2);
+						auto middle = std::min(pair + width, size);
+
+						auto a = source + static_cast<std::iter_difference_t<decltype(source)>>(pair);
+						auto b = source + static_cast<std::iter_difference_t<decltype(source)>>(middle);
+						auto [a_first, a_last] = (*splits)[chunk];
+						auto b_first = begin - pair - a_first;
+						auto b_last = end - pair - a_last;
+						std::merge(std::make_move_iterator(a + a_first), std::make_move_iterator(a + a_last),
+								   std::make_move_iterator(b + b_first), std::make_move_iterator(b + b_last),
+								   dest + static_cast<std::iter_difference_t<decltype(dest)>>(begin), comp);
+					};
+				};
+
+				if (in_buffer) {
+					auto find = parallel_chunks(chunks, split(buffer->data));
+					co_await find;
+					auto pass = parallel_chunks(chunks, merge(buffer->data, first));
+					co_await pass;
+				} else {
+					auto find = parallel_chunks(chunks, split(first));
+					co_await find;
+					auto pass = parallel_chunks(chunks, merge(first, buffer->data));
+					co_await pass;
+				}
+				in_buffer = !in_buffer;
+			}
+
+			if (in_buffer) {
+				auto back = parallel_chunks(chunks, [first, size, grain, buffer](size_t chunk) {
+					auto begin = buffer->data + chunk * grain;
+					auto end = buffer->data + std::min((chunk + 1) * grain, size);
+					std::move(begin, end, first + static_cast<Diff>(chunk * grain));
+				});
+				co_await back;
+			}
+		}
+	}
+
+	template<typename Range>
+	concept ParallelRange = std::ranges::random_access_range<Range> && std::ranges::sized_range<Range> && std::ranges::borrowed_range<Range>;
+
+	/*
+	 * Calls fn(element) for every element of the range.
+	 * std::views::iota(0, n) turns this into an indexed loop.
+	 */
+	template<ParallelRange Range, typename Fn>
+	requires std::invocable<const Fn&, std::ranges::range_reference_t<Range>>
+	Task<> parallel_for(Range&& range, size_t grain, Fn fn) {
+		auto first = std::ranges::begin(range);
+		auto size = static_cast<size_t>(std::ranges::size(range));
+		grain = internal::parallel_grain(size, grain);
+
+		return internal::parallel_chunks(internal::parallel_chunk_count(size, grain), [first, size, grain, fn = std::move(fn)](size_t chunk) {
+			auto begin = chunk * grain;
+			auto end = std::min(begin + grain, size);
+			auto it = first + static_cast<std::ranges::range_difference_t<Range>>(begin);
+			for (auto i = begin; i < end; i++, ++it) {
+				fn(*it);
+			}
+		});
+	}
+
+	/*
+	 * Folds the range with op, which must be associative: elements are grouped in unspecified order,
+	 * but their relative order is kept. init is only used once.
+	 */
+	template<ParallelRange Range, typename T, typename Op = std::plus<>>
+	Task<T> parallel_reduce(Range&& range, size_t grain, T init, Op op = {}) {
+		auto size = static_cast<size_t>(std::ranges::size(range));
+		return internal::parallel_reduce(std::ranges::begin(range), size, internal::parallel_grain(size, grain), std::move(init), std::move(op));
+	}
+
+	/*
+	 * Writes the inclusive prefix sums of the range to out, which may be the range's own begin().
+	 * op must be associative.
+	 */
+	template<ParallelRange Range, std::random_access_iterator OutIt, typename Op = std::plus<>>
+	Task<> parallel_inclusive_scan(Range&& range, OutIt out, size_t grain, Op op = {}) {
+		auto size = static_cast<size_t>(std::ranges::size(range));
+		return internal::parallel_inclusive_scan(std::ranges::begin(range), size, out, internal::parallel_grain(size, grain), std::move(op));
+	}
+
+	/*
+	 * Sorts every chunk in parallel, then merges them pairwise, each merge being split across workers. Not stable.
+	 * Needs a buffer as large as the range.
+	 */
+	template<ParallelRange Range, typename Comp = std::less<>>
+	requires std::sortable<std::ranges::iterator_t<Range>, Comp>
+	Task<> parallel_sort(Range&& range, size_t grain = 0, Comp comp = {}) {
+		auto size = static_cast<size_t>(std::ranges::size(range));
+		return internal::parallel_sort(std::ranges::begin(range), size, internal::parallel_grain(size, grain), std::move(comp));
+	}
+}
+
+#endif //COROUTINELIB_CC_PARALLEL_H
@@ -0,0 +1,124 @@
+#ifndef COROUTINELIB_CC_SCHEDULER_OBSERVER_H
+#define COROUTINELIB_CC_SCHEDULER_OBSERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <memory>
+#include <mutex>
+#include "cc_api.h"
+#include "cc_epoch.h"
+
+namespace crlib {
+	/*
+	 * Receives scheduling events from a ThreadPool, or from the scheduler it is installed on.
+	 * The hooks are compiled in by defining CRLIB_OBSERVERS (the CRLIB_OBSERVERS CMake option): otherwise
+	 * installing an observer has no effect and costs nothing. Hooks run on the threads involved, so they should be quick.
+	 */
+	struct SchedulerObserver {
+		virtual ~SchedulerObserver() = default;
+
+		virtual void on_submit(std::coroutine_handle<>) {
+
+		}
+
+		virtual void on_resume_begin(std::coroutine_handle<>) {
+
+		}
+
+		/*
+		 * The coroutine may have completed, and its frame been destroyed, during the resume: the handle is only an identifier here.
+		 * The duration is the thread CPU time spent in the resume when accounting is enabled, 0 otherwise.
+		 */
+		virtual void on_resume_end(std::coroutine_handle<>, std::chrono::nanoseconds) {
+
+		}
+
+		virtual void on_steal(std::coroutine_handle<>) {
+
+		}
+
+		// A worker found no work and is about to wait for some
+		virtual void on_park() {
+
+		}
+	};
+
+	namespace internal {
+		// CPU time consumed by the calling thread
+		CRLIB_API std::chrono::nanoseconds thread_cpu_time();
+
+#ifdef CRLIB_OBSERVERS
+		struct ObserverSlot {
+			std::atomic<SchedulerObserver*> current;
+			std::atomic_bool cpu_time;
+			std::mutex mutex;
+			std::shared_ptr<SchedulerObserver> installed;
+
+			ObserverSlot() : current(nullptr), cpu_time(false) {
+
+			}
+
+			void set(std::shared_ptr<SchedulerObserver> observer, bool account_cpu_time) {
+				std::lock_guard lock(mutex);
+				cpu_time.store(account_cpu_time, std::memory_order_relaxed);
+				current.store(observer.get(), std::memory_order_release);
+				// Other threads may still be calling the replaced observer, from within an EpochGuard
+				std::swap(installed, observer);
+				if (observer != nullptr) {
+					Epoch::retire(new std::shared_ptr<SchedulerObserver>(std::move(observer)));
+				}
+			}
+
+			// Only while in an EpochGuard
+			SchedulerObserver* get() const {
+				return current.load(std::memory_order_acquire);
+			}
+
+			[[nodiscard]] bool empty() const {
+				return current.load(std::memory_order_relaxed) == nullptr;
+			}
+
+			// Resumes h, reporting the resume to the observer
+			void resume(std::coroutine_handle<> h) {
+				if (empty()) {
+					h.resume();
+					return;
+				}
+
+				EpochGuard guard;
+				auto observer = get();
+				if (observer == nullptr) {
+					h.resume();
+					return;
+				}
+				observer->on_resume_begin(h);
+				if (cpu_time.load(std::memory_order_relaxed)) {
+					auto start = thread_cpu_time();
+					h.resume();
+					observer->on_resume_end(h, thread_cpu_time() - start);
+				} else {
+					h.resume();
+					observer->on_resume_end(h, std::chrono::nanoseconds(0));
+				}
+			}
+		};
+#endif
+	}
+}
+
+#ifdef CRLIB_OBSERVERS
+#define CC_OBSERVE(slot, call) do { \
+		if (!(slot).empty()) { \
+			crlib::EpochGuard cc_observer_guard; \
+			auto cc_observer = (slot).get(); \
+			if (cc_observer != nullptr) { \
+				cc_observer->call; \
+			} \
+		} \
+	} while (0)
+#else
+#define CC_OBSERVE(slot, call)
+#endif
+
+#endif //COROUTINELIB_CC_SCHEDULER_OBSERVER_H
@@ -9,60 +9,110 @@
 #include "cc_task.h"
 #include <functional>
 #include <atomic>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <utility>
+#include <stdexcept>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
 
 namespace crlib {
-    struct AsyncMutexLock {
-		using ValueType = void;
-        default_queue<std::function<void()>> waiting_queue;
-		std::atomic_bool busy;
-
-		void append_coroutine(std::function<void()> h) {
-			bool is_busy = busy.load();
-			if (!is_busy && busy.compare_exchange_strong(is_busy, true)) {
-				h();
-			} else {
-				waiting_queue.push(h);
-			}
+	namespace internal {
+		inline void cpu_relax() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+			_mm_pause();
+#else
+			std::this_thread::yield();
+#endif
 		}
 
-		void release() {
-			auto is_busy = busy.load();
-			if (busy) {
-				auto next = waiting_queue.pull();
-				if (next.has_value()) {
-					next.value()();
-				} else {
-					busy.compare_exchange_strong(is_busy, false);
-				}
-			}
+		template<typename Scheduler>
+		void schedule_waiter(std::coroutine_handle<> h) {
+			Scheduler::Schedule(h);
 		}
+	}
+
+	struct AsyncConditionVariable;
 
-		AsyncMutexLock() : busy(false) {
+	/*
+	 * Intrusive list node for a suspended coroutine. It lives inside the awaiter (and thus inside the
+	 * coroutine frame), so queueing a coroutine on a sync primitive allocates nothing.
+	 */
+	struct AsyncWaiter {
+		AsyncWaiter* next = nullptr;
+		std::coroutine_handle<> handle = nullptr;
+		void (*schedule)(std::coroutine_handle<>) = nullptr;
+		// Scheduler the coroutine suspended on, which resumes it
+		BaseTaskScheduler* home = nullptr;
+		// Called by AsyncMutex when handing the mutex to this waiter. Returning false declines the mutex:
+		// the hook is then responsible for queueing the waiter somewhere else
+		bool (*on_acquired)(AsyncWaiter*) = nullptr;
 
+		template<typename PromiseType>
+		void prepare(std::coroutine_handle<PromiseType> h) {
+			handle = h;
+			schedule = &internal::schedule_waiter<typename PromiseType::Scheduler>;
+			home = internal::Continuation<typename PromiseType::Scheduler>(h).home;
 		}
-    };
 
-    struct AsyncMutex {
-        std::shared_ptr<AsyncMutexLock> internal_lock;
+		// The waiter may be destroyed as soon as the coroutine resumes, do not touch it afterwards
+		void resume() {
+			if (home != nullptr) {
+				BaseTaskScheduler::ResumeOn(home, handle, false);
+			} else {
+				schedule(handle);
+			}
+		}
+	};
+
+	/*
+	 * An uncontended lock() is a single CAS and does not suspend.
+	 * Contended waiters are pushed on a lock-free stack, which the owner turns into a FIFO list on unlock():
+	 * the mutex is then handed directly to the first waiter, without being released in between.
+	 */
+	struct AsyncMutex {
+		friend AsyncConditionVariable;
 
 		struct AsyncMutexGuard {
 			friend AsyncMutex;
+			friend AsyncConditionVariable;
 		protected:
-			std::shared_ptr<AsyncMutexLock> internal_lock;
-			std::atomic_bool released;
+			AsyncMutex* mutex;
 
-			explicit AsyncMutexGuard(std::shared_ptr<AsyncMutexLock> lock) : internal_lock(std::move(lock)), released(false) {
+		public:
+			AsyncMutexGuard() noexcept : mutex(nullptr) {
 
 			}
-		public:
-			AsyncMutexGuard() = delete;
+
+			AsyncMutexGuard(AsyncMutex& mutex, std::adopt_lock_t) noexcept : mutex(&mutex) {
+
+			}
+
 			AsyncMutexGuard(const AsyncMutexGuard&) = delete;
 			AsyncMutexGuard& operator=(const AsyncMutexGuard&) = delete;
 
+			AsyncMutexGuard(AsyncMutexGuard&& other) noexcept : mutex(std::exchange(other.mutex, nullptr)) {
+
+			}
+
+			AsyncMutexGuard& operator=(AsyncMutexGuard&& other) noexcept {
+				if (this != &other) {
+					release();
+					mutex = std::exchange(other.mutex, nullptr);
+				}
+				return *this;
+			}
+
+			[[nodiscard]] bool owns_lock() const noexcept {
+				return mutex != nullptr;
+			}
+
 			inline void release() {
-				bool is_released = released.load();
-				if (!is_released && released.compare_exchange_strong(is_released, true)) {
-					internal_lock->release();
+				auto m = std::exchange(mutex, nullptr);
+				if (m != nullptr) {
+					m->unlock();
 				}
 			}
 
@@ -71,64 +121,1017 @@ namespace crlib {
 			}
 		};
 
-		AsyncMutex() : internal_lock(new AsyncMutexLock()) {
+		struct LockAwaiter {
+			AsyncMutex* mutex;
+			size_t spin_count;
+			AsyncWaiter waiter;
+
+			LockAwaiter(AsyncMutex* mutex, size_t spin_count) : mutex(mutex), spin_count(spin_count) {
+
+			}
+
+			bool await_ready() {
+				for (size_t i = 0; i < spin_count; i++) {
+					if (mutex->try_lock()) {
+						return true;
+					}
+					internal::cpu_relax();
+				}
+				return mutex->try_lock();
+			}
+
+			template<typename PromiseType>
+			bool await_suspend(std::coroutine_handle<PromiseType> h) {
+				waiter.prepare(h);
+				return mutex->enqueue(&waiter);
+			}
+
+			AsyncMutexGuard await_resume() {
+				return AsyncMutexGuard(*mutex, std::adopt_lock);
+			}
+		};
+
+	protected:
+		static constexpr std::uintptr_t not_locked = 1;
+		static constexpr std::uintptr_t locked_no_waiters = 0;
+
+		// not_locked, locked_no_waiters, or the head of the stack of newly queued waiters
+		std::atomic<std::uintptr_t> state;
+		// FIFO list of waiters, only accessed by the current owner
+		AsyncWaiter* waiters;
+
+		// Returns false if the mutex was acquired instead of queueing the waiter
+		bool enqueue(AsyncWaiter* waiter) {
+			auto old = state.load(std::memory_order_acquire);
+			while (true) {
+				if (old == not_locked) {
+					if (state.compare_exchange_weak(old, locked_no_waiters, std::memory_order_acquire, std::memory_order_relaxed)) {
+						return false;
+					}
+				} else {
+					waiter->next = reinterpret_cast<AsyncWaiter*>(old);
+					if (state.compare_exchange_weak(old, reinterpret_cast<std::uintptr_t>(waiter), std::memory_order_release, std::memory_order_relaxed)) {
+						return true;
+					}
+				}
+			}
+		}
+
+	public:
+		AsyncMutex() : state(not_locked), waiters(nullptr) {
 
 		}
 		AsyncMutex(const AsyncMutex&) = delete;
 		AsyncMutex& operator=(const AsyncMutex&) = delete;
 
+		bool try_lock() {
+			auto old = not_locked;
+			return state.compare_exchange_strong(old, locked_no_waiters, std::memory_order_acquire, std::memory_order_relaxed);
+		}
+
+		void unlock() {
+			while (true) {
+				auto head = waiters;
+				if (head == nullptr) {
+					auto old = locked_no_waiters;
+					if (state.compare_exchange_strong(old, not_locked, std::memory_order_release, std::memory_order_relaxed)) {
+						return;
+					}
+
+					old = state.exchange(locked_no_waiters, std::memory_order_acquire);
+					auto w = reinterpret_cast<AsyncWaiter*>(old);
+					while (w != nullptr) {
+						auto next = w->next;
+						w->next = head;
+						head = w;
+						w = next;
+					}
+				}
+
+				waiters = head->next;
+				if (head->on_acquired == nullptr || head->on_acquired(head)) {
+					head->resume();
+					return;
+				}
+				// The waiter declined the mutex, which is still owned: pass it on to the next one
+			}
+		}
+
+		// co_await mutex.lock() returns an AsyncMutexGuard holding the mutex
+		LockAwaiter lock() {
+			return {this, 0};
+		}
+
+		// Like lock(), but spins on try_lock() before suspending. Meant for very short critical sections
+		LockAwaiter lock_or_spin(size_t spin_count = 64) {
+			return {this, spin_count};
+		}
+
 		ValueTask<std::unique_ptr<AsyncMutexGuard>> await() {
-			co_await TaskAwaiter<AsyncMutexLock>(internal_lock);
-			co_return std::unique_ptr<AsyncMutexGuard>(new AsyncMutexGuard(internal_lock));
+			auto guard = co_await lock();
+			co_return std::make_unique<AsyncMutexGuard>(std::move(guard));
 		}
-    };
+	};
+
+	/*
+	 * Reader/writer mutex for coroutines. Readers and writers take the mutex with a single CAS when nobody is queued.
+	 * The policy is writer-preferring: once a writer is queued, new readers queue behind it.
+	 * When a writer releases the mutex, every queued reader is woken at once.
+	 */
+	struct AsyncSharedMutex {
+		struct SharedGuard {
+		protected:
+			AsyncSharedMutex* mutex;
+
+		public:
+			SharedGuard() noexcept : mutex(nullptr) {
+
+			}
+
+			SharedGuard(AsyncSharedMutex& mutex, std::adopt_lock_t) noexcept : mutex(&mutex) {
+
+			}
+
+			SharedGuard(const SharedGuard&) = delete;
+			SharedGuard& operator=(const SharedGuard&) = delete;
+
+			SharedGuard(SharedGuard&& other) noexcept : mutex(std::exchange(other.mutex, nullptr)) {
+
+			}
+
+			SharedGuard& operator=(SharedGuard&& other) noexcept {
+				if (this != &other) {
+					release();
+					mutex = std::exchange(other.mutex, nullptr);
+				}
+				return *this;
+			}
+
+			[[nodiscard]] bool owns_lock() const noexcept {
+				return mutex != nullptr;
+			}
 
-	struct AsyncConditionVariableLock {
-		using ValueType = void;
-		default_queue<std::function<void()>> queue;
+			inline void release() {
+				auto m = std::exchange(mutex, nullptr);
+				if (m != nullptr) {
+					m->unlock_shared();
+				}
+			}
+
+			~SharedGuard() {
+				release();
+			}
+		};
+
+		struct ExclusiveGuard {
+		protected:
+			AsyncSharedMutex* mutex;
+
+		public:
+			ExclusiveGuard() noexcept : mutex(nullptr) {
+
+			}
 
-		void append_coroutine(std::function<void()> f) {
-			queue.push(f);
+			ExclusiveGuard(AsyncSharedMutex& mutex, std::adopt_lock_t) noexcept : mutex(&mutex) {
+
+			}
+
+			ExclusiveGuard(const ExclusiveGuard&) = delete;
+			ExclusiveGuard& operator=(const ExclusiveGuard&) = delete;
+
+			ExclusiveGuard(ExclusiveGuard&& other) noexcept : mutex(std::exchange(other.mutex, nullptr)) {
+
+			}
+
+			ExclusiveGuard& operator=(ExclusiveGuard&& other) noexcept {
+				if (this != &other) {
+					release();
+					mutex = std::exchange(other.mutex, nullptr);
+				}
+				return *this;
+			}
+
+			[[nodiscard]] bool owns_lock() const noexcept {
+				return mutex != nullptr;
+			}
+
+			inline void release() {
+				auto m = std::exchange(mutex, nullptr);
+				if (m != nullptr) {
+					m->unlock();
+				}
+			}
+
+			~ExclusiveGuard() {
+				release();
+			}
+		};
+
+		struct SharedLockAwaiter {
+			AsyncSharedMutex* mutex;
+			AsyncWaiter waiter;
+
+			explicit SharedLockAwaiter(AsyncSharedMutex* mutex) : mutex(mutex) {
+
+			}
+
+			bool await_ready() {
+				return mutex->try_lock_shared();
+			}
+
+			template<typename PromiseType>
+			bool await_suspend(std::coroutine_handle<PromiseType> h) {
+				waiter.prepare(h);
+				return mutex->enqueue(&waiter, true);
+			}
+
+			SharedGuard await_resume() {
+				return SharedGuard(*mutex, std::adopt_lock);
+			}
+		};
+
+		struct ExclusiveLockAwaiter {
+			AsyncSharedMutex* mutex;
+			AsyncWaiter waiter;
+
+			explicit ExclusiveLockAwaiter(AsyncSharedMutex* mutex) : mutex(mutex) {
+
+			}
+
+			bool await_ready() {
+				return mutex->try_lock();
+			}
+
+			template<typename PromiseType>
+			bool await_suspend(std::coroutine_handle<PromiseType> h) {
+				waiter.prepare(h);
+				return mutex->enqueue(&waiter, false);
+			}
+
+			ExclusiveGuard await_resume() {
+				return ExclusiveGuard(*mutex, std::adopt_lock);
+			}
+		};
+
+	protected:
+		static constexpr std::uint64_t writer_flag = 1;
+		// Set while any coroutine is queued: it forces every acquisition through the queue_mutex slow path
+		static constexpr std::uint64_t waiting_flag = 2;
+		static constexpr std::uint64_t reader_unit = 4;
+
+		std::atomic<std::uint64_t> state;
+
+		std::mutex queue_mutex;
+		AsyncWaiter* readers_head;
+		AsyncWaiter* readers_tail;
+		AsyncWaiter* writers_head;
+		AsyncWaiter* writers_tail;
+
+		static void append(AsyncWaiter*& head, AsyncWaiter*& tail, AsyncWaiter* waiter) {
+			waiter->next = nullptr;
+			if (tail == nullptr) {
+				head = waiter;
+			} else {
+				tail->next = waiter;
+			}
+			tail = waiter;
 		}
 
-		void notify_one() {
-			auto v = queue.pull();
-			if (v.has_value()) {
-				v.value()();
+		// Returns false if the mutex was acquired instead of queueing the waiter
+		bool enqueue(AsyncWaiter* waiter, bool shared) {
+			std::unique_lock lock(queue_mutex);
+
+			auto s = state.load(std::memory_order_acquire);
+			while (true) {
+				bool can_acquire = shared ?
+						(s & writer_flag) == 0 && writers_head == nullptr :
+						s == 0;
+
+				if (can_acquire) {
+					if (state.compare_exchange_weak(s, s + (shared ? reader_unit : writer_flag), std::memory_order_acquire, std::memory_order_relaxed)) {
+						return false;
+					}
+				} else if (state.compare_exchange_weak(s, s | waiting_flag, std::memory_order_relaxed, std::memory_order_relaxed)) {
+					break;
+				}
 			}
+
+			if (shared) {
+				append(readers_head, readers_tail, waiter);
+			} else {
+				append(writers_head, writers_tail, waiter);
+			}
+			return true;
 		}
 
-		void notify_all() {
-			auto v = queue.pull();
-			while(v.has_value()) {
-				v.value()();
+		// Called with queue_mutex held. Hands the mutex to the next waiters, if nobody holds it anymore
+		AsyncWaiter* dispatch(bool released_by_writer) {
+			if (state.load(std::memory_order_acquire) != waiting_flag) {
+				return nullptr;
+			}
+
+			AsyncWaiter* woken = nullptr;
+			std::uint64_t next_state;
+
+			if (readers_head != nullptr && (released_by_writer || writers_head == nullptr)) {
+				woken = std::exchange(readers_head, nullptr);
+				readers_tail = nullptr;
 
-				v = queue.pull();
+				std::uint64_t count = 0;
+				for (auto w = woken; w != nullptr; w = w->next) {
+					count++;
+				}
+				next_state = count * reader_unit;
+			} else if (writers_head != nullptr) {
+				woken = writers_head;
+				writers_head = woken->next;
+				if (writers_head == nullptr) {
+					writers_tail = nullptr;
+				}
+				woken->next = nullptr;
+				next_state = writer_flag;
+			} else {
+				next_state = 0;
 			}
+
+			if (readers_head != nullptr || writers_head != nullptr) {
+				next_state |= waiting_flag;
+			}
+			state.store(next_state, std::memory_order_release);
+			return woken;
+		}
+
+		static void resume_all(AsyncWaiter* w) {
+			while (w != nullptr) {
+				auto next = w->next;
+				w->resume();
+				w = next;
+			}
+		}
+
+	public:
+		AsyncSharedMutex() : state(0), readers_head(nullptr), readers_tail(nullptr), writers_head(nullptr), writers_tail(nullptr) {
+
+		}
+		AsyncSharedMutex(const AsyncSharedMutex&) = delete;
+		AsyncSharedMutex& operator=(const AsyncSharedMutex&) = delete;
+
+		bool try_lock_shared() {
+			auto s = state.load(std::memory_order_relaxed);
+			while ((s & (writer_flag | waiting_flag)) == 0) {
+				if (state.compare_exchange_weak(s, s + reader_unit, std::memory_order_acquire, std::memory_order_relaxed)) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool try_lock() {
+			std::uint64_t s = 0;
+			return state.compare_exchange_strong(s, writer_flag, std::memory_order_acquire, std::memory_order_relaxed);
+		}
+
+		void unlock_shared() {
+			auto previous = state.fetch_sub(reader_unit, std::memory_order_release);
+			if (previous != (reader_unit | waiting_flag)) {
+				return;
+			}
+
+			AsyncWaiter* woken;
+			{
+				std::lock_guard lock(queue_mutex);
+				woken = dispatch(false);
+			}
+			resume_all(woken);
+		}
+
+		void unlock() {
+			auto s = writer_flag;
+			if (state.compare_exchange_strong(s, 0, std::memory_order_release, std::memory_order_relaxed)) {
+				return;
+			}
+
+			AsyncWaiter* woken;
+			{
+				std::lock_guard lock(queue_mutex);
+				state.fetch_and(~writer_flag, std::memory_order_release);
+				woken = dispatch(true);
+			}
+			resume_all(woken);
+		}
+
+		// co_await mutex.lock_shared() returns a SharedGuard
+		SharedLockAwaiter lock_shared() {
+			return SharedLockAwaiter(this);
+		}
+
+		// co_await mutex.lock() returns an ExclusiveGuard
+		ExclusiveLockAwaiter lock() {
+			return ExclusiveLockAwaiter(this);
 		}
 	};
 
+	/*
+	 * Counting semaphore for coroutines. Permits are taken with a CAS while nobody is queued;
+	 * queued coroutines are served in FIFO order, and release(n) resumes as many of them as the permits allow.
+	 */
+	struct AsyncSemaphore {
+		struct Permit {
+		protected:
+			AsyncSemaphore* semaphore;
+			size_t count;
+
+		public:
+			Permit() noexcept : semaphore(nullptr), count(0) {
+
+			}
+
+			Permit(AsyncSemaphore& semaphore, size_t count, std::adopt_lock_t) noexcept : semaphore(&semaphore), count(count) {
+
+			}
+
+			Permit(const Permit&) = delete;
+			Permit& operator=(const Permit&) = delete;
+
+			Permit(Permit&& other) noexcept : semaphore(std::exchange(other.semaphore, nullptr)), count(std::exchange(other.count, 0)) {
+
+			}
+
+			Permit& operator=(Permit&& other) noexcept {
+				if (this != &other) {
+					release();
+					semaphore = std::exchange(other.semaphore, nullptr);
+					count = std::exchange(other.count, 0);
+				}
+				return *this;
+			}
+
+			[[nodiscard]] size_t size() const noexcept {
+				return semaphore != nullptr ? count : 0;
+			}
+
+			inline void release() {
+				auto s = std::exchange(semaphore, nullptr);
+				if (s != nullptr) {
+					s->release(std::exchange(count, 0));
+				}
+			}
+
+			~Permit() {
+				release();
+			}
+		};
+
+		struct SemaphoreWaiter : public AsyncWaiter {
+			size_t count = 0;
+		};
+
+		struct AcquireAwaiter {
+			AsyncSemaphore* semaphore;
+			SemaphoreWaiter waiter;
+
+			AcquireAwaiter(AsyncSemaphore* semaphore, size_t count) : semaphore(semaphore) {
+				waiter.count = count;
+			}
+
+			bool await_ready() {
+				return semaphore->try_acquire(waiter.count);
+			}
+
+			template<typename PromiseType>
+			bool await_suspend(std::coroutine_handle<PromiseType> h) {
+				waiter.prepare(h);
+				return semaphore->enqueue(&waiter);
+			}
+
+			Permit await_resume() {
+				return Permit(*semaphore, waiter.count, std::adopt_lock);
+			}
+		};
+
+	protected:
+		std::atomic<std::ptrdiff_t> permits;
+		std::atomic_bool has_waiters;
+
+		std::mutex queue_mutex;
+		SemaphoreWaiter* head;
+		SemaphoreWaiter* tail;
+
+		bool take(size_t count) {
+			auto available = permits.load();
+			while (available >= static_cast<std::ptrdiff_t>(count)) {
+				if (permits.compare_exchange_weak(available, available - static_cast<std::ptrdiff_t>(count))) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Returns false if the permits were acquired instead of queueing the waiter
+		bool enqueue(SemaphoreWaiter* waiter) {
+			std::lock_guard lock(queue_mutex);
+
+			// Publish the flag before the last check, so that a concurrent release() cannot miss this waiter
+			has_waiters.store(true);
+			if (head == nullptr && take(waiter->count)) {
+				has_waiters.store(false);
+				return false;
+			}
+
+			waiter->next = nullptr;
+			if (tail == nullptr) {
+				head = waiter;
+			} else {
+				tail->next = waiter;
+			}
+			tail = waiter;
+			return true;
+		}
+
+	public:
+		explicit AsyncSemaphore(size_t initial_permits) : permits(static_cast<std::ptrdiff_t>(initial_permits)), has_waiters(false), head(nullptr), tail(nullptr) {
+
+		}
+		AsyncSemaphore(const AsyncSemaphore&) = delete;
+		AsyncSemaphore& operator=(const AsyncSemaphore&) = delete;
+
+		[[nodiscard]] size_t available() const {
+			auto p = permits.load(std::memory_order_relaxed);
+			return p > 0 ? static_cast<size_t>(p) : 0;
+		}
+
+		// Does not overtake coroutines that are already queued
+		bool try_acquire(size_t count = 1) {
+			if (has_waiters.load(std::memory_order_relaxed)) {
+				return false;
+			}
+			return take(count);
+		}
+
+		void release(size_t count = 1) {
+			permits.fetch_add(static_cast<std::ptrdiff_t>(count));
+			if (!has_waiters.load()) {
+				return;
+			}
+
+			AsyncWaiter* woken = nullptr;
+			AsyncWaiter* woken_tail = nullptr;
+			{
+				std::lock_guard lock(queue_mutex);
+				while (head != nullptr && take(head->count)) {
+					auto w = head;
+					head = static_cast<SemaphoreWaiter*>(w->next);
+					w->next = nullptr;
+					if (woken_tail == nullptr) {
+						woken = w;
+					} else {
+						woken_tail->next = w;
+					}
+					woken_tail = w;
+				}
+
+				if (head == nullptr) {
+					tail = nullptr;
+					has_waiters.store(false);
+				}
+			}
+
+			while (woken != nullptr) {
+				auto next = woken->next;
+				woken->resume();
+				woken = next;
+			}
+		}
+
+		// co_await semaphore.acquire(n) returns a Permit, which gives the n permits back when destroyed
+		AcquireAwaiter acquire(size_t count = 1) {
+			return {this, count};
+		}
+	};
+
+	/*
+	 * Event that stays signaled once set(), until reset(). Waiters are kept on a lock-free intrusive stack
+	 * in the same atomic word that holds the signaled state.
+	 */
+	struct AsyncManualResetEvent {
+		struct WaitAwaiter {
+			AsyncManualResetEvent* event;
+			AsyncWaiter waiter;
+
+			explicit WaitAwaiter(AsyncManualResetEvent* event) : event(event) {
+
+			}
+
+			bool await_ready() {
+				return event->is_set();
+			}
+
+			template<typename PromiseType>
+			bool await_suspend(std::coroutine_handle<PromiseType> h) {
+				waiter.prepare(h);
+				return event->enqueue(&waiter);
+			}
+
+			void await_resume() {
+
+			}
+		};
+
+	protected:
+		// 'this' when set, otherwise the head of the waiters stack
+		std::atomic<void*> state;
+
+		// Returns false if the event is already set
+		bool enqueue(AsyncWaiter* waiter) {
+			void* old = state.load(std::memory_order_acquire);
+			do {
+				if (old == this) {
+					return false;
+				}
+				waiter->next = static_cast<AsyncWaiter*>(old);
+			} while (!state.compare_exchange_weak(old, waiter, std::memory_order_release, std::memory_order_acquire));
+			return true;
+		}
+
+	public:
+		explicit AsyncManualResetEvent(bool initially_set = false) : state(initially_set ? this : nullptr) {
+
+		}
+		AsyncManualResetEvent(const AsyncManualResetEvent&) = delete;
+		AsyncManualResetEvent& operator=(const AsyncManualResetEvent&) = delete;
+
+		[[nodiscard]] bool is_set() const {
+			return state.load(std::memory_order_acquire) == this;
+		}
+
+		void set() {
+			void* old = state.exchange(this, std::memory_order_acq_rel);
+			if (old == this) {
+				return;
+			}
+
+			auto w = static_cast<AsyncWaiter*>(old);
+			while (w != nullptr) {
+				auto next = w->next;
+				w->resume();
+				w = next;
+			}
+		}
+
+		void reset() {
+			void* old = this;
+			state.compare_exchange_strong(old, nullptr, std::memory_order_relaxed);
+		}
+
+		WaitAwaiter wait() {
+			return WaitAwaiter(this);
+		}
+	};
+
+	/*
+	 * Single-use countdown: co_await wait() resumes once count_down() brought the counter to zero.
+	 */
+	struct AsyncLatch {
+	protected:
+		std::atomic<std::ptrdiff_t> count;
+		AsyncManualResetEvent event;
+
+	public:
+		explicit AsyncLatch(std::ptrdiff_t expected) : count(expected), event(expected <= 0) {
+
+		}
+		AsyncLatch(const AsyncLatch&) = delete;
+		AsyncLatch& operator=(const AsyncLatch&) = delete;
+
+		void count_down(std::ptrdiff_t n = 1) {
+			auto old = count.fetch_sub(n, std::memory_order_acq_rel);
+			if (old > 0 && old - n <= 0) {
+				event.set();
+			}
+		}
+
+		[[nodiscard]] bool try_wait() const {
+			return count.load(std::memory_order_acquire) <= 0;
+		}
+
+		AsyncManualResetEvent::WaitAwaiter wait() {
+			return event.wait();
+		}
+
+		AsyncManualResetEvent::WaitAwaiter arrive_and_wait(std::ptrdiff_t n = 1) {
+			count_down(n);
+			return event.wait();
+		}
+	};
+
+	/*
+	 * Reusable phase barrier for a fixed number of participants. The last coroutine to arrive does not suspend:
+	 * it starts the next phase and resumes the others. co_await arrive_and_wait() returns true for that coroutine only.
+	 */
+	struct AsyncBarrier {
+		struct ArriveAwaiter {
+			AsyncBarrier* barrier;
+			AsyncWaiter waiter;
+			bool completed_phase = false;
+
+			explicit ArriveAwaiter(AsyncBarrier* barrier) : barrier(barrier) {
+
+			}
+
+			bool await_ready() {
+				return false;
+			}
+
+			template<typename PromiseType>
+			bool await_suspend(std::coroutine_handle<PromiseType> h) {
+				waiter.prepare(h);
+				// Unless it completed the phase, the coroutine may be resumed, and this awaiter destroyed, before arrive() returns
+				if (barrier->arrive(&waiter)) {
+					completed_phase = true;
+					return false;
+				}
+				return true;
+			}
+
+			bool await_resume() {
+				return completed_phase;
+			}
+		};
+
+	protected:
+		const std::ptrdiff_t expected;
+		std::atomic<std::ptrdiff_t> remaining;
+		std::atomic<AsyncWaiter*> waiters;
+
+		// Returns true if this arrival completed the phase
+		bool arrive(AsyncWaiter* waiter) {
+			// The waiter is pushed before counting the arrival, so the last one always finds every other waiter
+			auto head = waiters.load(std::memory_order_relaxed);
+			do {
+				waiter->next = head;
+			} while (!waiters.compare_exchange_weak(head, waiter, std::memory_order_release, std::memory_order_relaxed));
+
+			if (remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+				return false;
+			}
+
+			remaining.store(expected, std::memory_order_relaxed);
+			auto w = waiters.exchange(nullptr, std::memory_order_acquire);
+			while (w != nullptr) {
+				auto next = w->next;
+				if (w != waiter) {
+					w->resume();
+				}
+				w = next;
+			}
+			return true;
+		}
+
+	public:
+		explicit AsyncBarrier(std::ptrdiff_t participants) : expected(participants), remaining(participants), waiters(nullptr) {
+			if (participants <= 0) {
+				throw std::invalid_argument("AsyncBarrier needs at least one participant");
+			}
+		}
+		AsyncBarrier(const AsyncBarrier&) = delete;
+		AsyncBarrier& operator=(const AsyncBarrier&) = delete;
+
+		ArriveAwaiter arrive_and_wait() {
+			return ArriveAwaiter(this);
+		}
+	};
+
+	/*
+	 * Go-style wait group: add() before starting some work, done() when it completes,
+	 * co_await wait() resumes once the counter is back to zero. It can be reused once the waiters resumed.
+	 */
+	struct WaitGroup {
+	protected:
+		std::atomic<std::ptrdiff_t> count;
+		AsyncManualResetEvent event;
+
+	public:
+		WaitGroup() : count(0), event(true) {
+
+		}
+		WaitGroup(const WaitGroup&) = delete;
+		WaitGroup& operator=(const WaitGroup&) = delete;
+
+		void add(std::ptrdiff_t delta = 1) {
+			auto old = count.fetch_add(delta, std::memory_order_acq_rel);
+			auto current = old + delta;
+			if (current < 0) {
+				throw std::logic_error("WaitGroup counter went below zero");
+			}
+
+			if (old == 0 && current > 0) {
+				// The done() that brought the counter to zero may not have set the event yet
+				while (!event.is_set()) {
+					internal::cpu_relax();
+				}
+				event.reset();
+			} else if (old > 0 && current == 0) {
+				event.set();
+			}
+		}
+
+		void done() {
+			add(-1);
+		}
+
+		[[nodiscard]] std::ptrdiff_t pending() const {
+			return count.load(std::memory_order_acquire);
+		}
+
+		AsyncManualResetEvent::WaitAwaiter wait() {
+			return event.wait();
+		}
+	};
+
+	/*
+	 * Condition variable for coroutines holding an AsyncMutex.
+	 * co_await cv.wait(guard, pred) releases the mutex and queues the coroutine in a single step, so a notification
+	 * sent while holding the mutex is never lost. Notified waiters are moved to the mutex queue instead of being resumed:
+	 * they get the mutex directly from its current owner, and the predicate is checked before resuming them.
+	 * The predicate is evaluated by whichever thread hands over the mutex, always while the mutex is held, and must not throw.
+	 */
 	struct AsyncConditionVariable {
+		struct CvWaiter : AsyncWaiter {
+			// nullptr for waiters without a mutex, which are resumed directly
+			AsyncMutex* mutex = nullptr;
+		};
+
+		template<typename Predicate>
+		struct WaitAwaiter {
+			struct Waiter : CvWaiter {
+				WaitAwaiter* awaiter = nullptr;
+			};
+
+			AsyncConditionVariable* cv;
+			AsyncMutex::AsyncMutexGuard* guard;
+			Predicate predicate;
+			Waiter waiter;
+
+			WaitAwaiter(AsyncConditionVariable* cv, AsyncMutex::AsyncMutexGuard* guard, Predicate predicate) : cv(cv), guard(guard), predicate(std::move(predicate)) {
+
+			}
+
+			bool await_ready() {
+				if (!guard->owns_lock()) {
+					throw std::logic_error("AsyncConditionVariable::wait() requires a guard owning its mutex");
+				}
+				return predicate();
+			}
+
+			template<typename PromiseType>
+			void await_suspend(std::coroutine_handle<PromiseType> h) {
+				waiter.prepare(h);
+				waiter.awaiter = this;
+				waiter.on_acquired = &WaitAwaiter::acquired;
+				waiter.mutex = std::exchange(guard->mutex, nullptr);
+
+				auto mutex = waiter.mutex;
+				cv->enqueue(&waiter);
+				// From here on the coroutine may be resumed at any time
+				mutex->unlock();
+			}
+
+			void await_resume() {
+				if (waiter.mutex != nullptr) {
+					guard->mutex = waiter.mutex;
+				}
+			}
+
+			static bool acquired(AsyncWaiter* w) {
+				auto self = static_cast<Waiter*>(w)->awaiter;
+				if (self->predicate()) {
+					return true;
+				}
+				self->cv->enqueue(w);
+				return false;
+			}
+		};
+
+		struct NotifiedPredicate {
+			bool called = false;
+
+			// Fails on the initial check only, so the coroutine waits for exactly one notification
+			bool operator()() {
+				return std::exchange(called, true);
+			}
+		};
+
+		struct SignalAwaiter {
+			AsyncConditionVariable* cv;
+			CvWaiter waiter;
+
+			explicit SignalAwaiter(AsyncConditionVariable* cv) : cv(cv) {
+
+			}
+
+			bool await_ready() {
+				return false;
+			}
+
+			template<typename PromiseType>
+			void await_suspend(std::coroutine_handle<PromiseType> h) {
+				waiter.prepare(h);
+				cv->enqueue(&waiter);
+			}
+
+			void await_resume() {
+
+			}
+		};
+
 	protected:
-		std::shared_ptr<AsyncConditionVariableLock> lock;
+		std::mutex queue_mutex;
+		AsyncWaiter* head;
+		AsyncWaiter* tail;
+
+		void enqueue(AsyncWaiter* waiter) {
+			std::lock_guard<std::mutex> l(queue_mutex);
+			waiter->next = nullptr;
+			if (tail == nullptr) {
+				head = waiter;
+			} else {
+				tail->next = waiter;
+			}
+			tail = waiter;
+		}
+
+		static void hand_off(AsyncWaiter* waiter) {
+			auto mutex = static_cast<CvWaiter*>(waiter)->mutex;
+			if (mutex == nullptr) {
+				waiter->resume();
+				return;
+			}
+
+			if (mutex->enqueue(waiter)) {
+				return;
+			}
+
+			// The mutex was free and is now owned on behalf of the waiter
+			if (waiter->on_acquired == nullptr || waiter->on_acquired(waiter)) {
+				waiter->resume();
+			} else {
+				mutex->unlock();
+			}
+		}
+
 	public:
-		AsyncConditionVariable() : lock(new AsyncConditionVariableLock()) {
+		AsyncConditionVariable() : head(nullptr), tail(nullptr) {
 
 		}
 
 		AsyncConditionVariable(const AsyncConditionVariable&) = delete;
 		AsyncConditionVariable& operator=(const AsyncConditionVariable&) = delete;
 
-		TaskAwaiter<AsyncConditionVariableLock> await() {
-			return {lock};
+		// Resumes (holding the mutex again) once notified
+		WaitAwaiter<NotifiedPredicate> wait(AsyncMutex::AsyncMutexGuard& guard) {
+			return {this, &guard, NotifiedPredicate{}};
 		}
 
-		void notify_all() {
-			lock->notify_all();
+		// Resumes (holding the mutex again) once pred() returns true. Does not suspend if it already does
+		template<typename Predicate>
+		WaitAwaiter<std::decay_t<Predicate>> wait(AsyncMutex::AsyncMutexGuard& guard, Predicate&& pred) {
+			return {this, &guard, std::forward<Predicate>(pred)};
+		}
+
+		// Waits for a notification without any associated mutex
+		SignalAwaiter await() {
+			return SignalAwaiter(this);
 		}
 
 		void notify_one() {
-			lock->notify_one();
+			AsyncWaiter* w;
+			{
+				std::lock_guard<std::mutex> l(queue_mutex);
+				w = head;
+				if (w == nullptr) {
+					return;
+				}
+				head = w->next;
+				if (head == nullptr) {
+					tail = nullptr;
+				}
+			}
+			hand_off(w);
+		}
+
+		void notify_all() {
+			AsyncWaiter* w;
+			{
+				std::lock_guard<std::mutex> l(queue_mutex);
+				w = std::exchange(head, nullptr);
+				tail = nullptr;
+			}
+
+			while (w != nullptr) {
+				auto next = w->next;
+				hand_off(w);
+				w = next;
+			}
 		}
 	};
 }
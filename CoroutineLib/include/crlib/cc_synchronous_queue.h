@@ -20,6 +20,10 @@ namespace crlib {
 			return true;
 		}
 
+		bool push_single_producer(T item) {
+			return push(std::move(item));
+		}
+
 		std::optional<T> pull() {
 			std::lock_guard guard(mutex);
 
@@ -17,6 +17,12 @@
 template<typename ... Args, typename Scheduler>
 struct std::coroutine_traits<crlib::Task<void, Scheduler>, Args...> {
     struct promise_type : public crlib::BasePromise<crlib::Task<void, Scheduler>, crlib::Task_lock<void>> {
+#ifdef CRLIB_INSPECTOR
+        promise_type(std::source_location location = std::source_location::current()) : promise_type::BasePromise(location) {
+
+        }
+#endif
+
         void return_void() {
 
         }
@@ -26,6 +32,12 @@ struct std::coroutine_traits<crlib::Task<void, Scheduler>, Args...> {
 template<typename T, typename ... Args, typename Scheduler>
 struct std::coroutine_traits<crlib::Task<T, Scheduler>, Args...> {
     struct promise_type : public crlib::BasePromise<crlib::Task<T, Scheduler>, crlib::Task_lock<T>> {
+#ifdef CRLIB_INSPECTOR
+        promise_type(std::source_location location = std::source_location::current()) : promise_type::BasePromise(location) {
+
+        }
+#endif
+
         void return_value(T val) {
             this->lock->set_result(std::move(val));
 		}
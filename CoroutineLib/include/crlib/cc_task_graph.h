@@ -0,0 +1,291 @@
+#ifndef COROUTINELIB_CC_TASK_GRAPH_H
+#define COROUTINELIB_CC_TASK_GRAPH_H
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include "cc_task.h"
+
+namespace crlib {
+	namespace internal {
+		// Coroutine that is only ever resumed by the graph that owns it
+		struct GraphRoutine {
+			struct promise_type {
+				GraphRoutine get_return_object() {
+					return {std::coroutine_handle<promise_type>::from_promise(*this)};
+				}
+
+				std::suspend_always initial_suspend() noexcept {
+					return {};
+				}
+
+				std::suspend_always final_suspend() noexcept {
+					return {};
+				}
+
+				void return_void() {
+
+				}
+
+				void unhandled_exception() {
+					std::terminate();
+				}
+			};
+
+			std::coroutine_handle<promise_type> handle;
+		};
+	}
+
+	/*
+	 * Directed acyclic graph of work items, executed on the thread pool as a unit.
+	 * Every node counts its pending predecessors: the node that completes the last of them makes it ready. The first
+	 * ready successor runs right away on the same worker, the others are submitted to the pool.
+	 * Every node gets a reusable coroutine frame the first time it runs, so running the graph again allocates nothing.
+	 * Nodes and edges can be added between runs, but not while the graph is running.
+	 * If a node throws, the nodes that did not start yet are skipped and run() rethrows the first exception.
+	 */
+	class TaskGraph {
+	public:
+		using NodeId = size_t;
+
+	protected:
+		struct Node {
+			std::function<void()> work;
+			std::vector<Node*> successors;
+			size_t predecessors = 0;
+			std::atomic_size_t pending = 0;
+			std::coroutine_handle<> handle = nullptr;
+
+			explicit Node(std::function<void()> work) : work(std::move(work)) {
+
+			}
+		};
+
+		struct NodeFinished {
+			TaskGraph* graph;
+			size_t finished;
+
+			constexpr bool await_ready() {
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<>) {
+				// Once every node finished, this frame may be resumed by the next run: nothing can touch it after this
+				graph->complete(finished);
+			}
+
+			void await_resume() {
+
+			}
+		};
+
+		struct RunAwaiter {
+			TaskGraph* graph;
+
+			constexpr bool await_ready() {
+				return false;
+			}
+
+			bool await_suspend(std::coroutine_handle<> h) {
+				graph->waiter = h;
+				// The run holds one count itself, so that the nodes cannot complete it before the waiter is stored
+				return graph->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1;
+			}
+
+			void await_resume() {
+
+			}
+		};
+
+		std::vector<std::unique_ptr<Node>> nodes;
+		std::vector<Node*> roots;
+		bool dirty = false;
+		std::atomic_bool running = false;
+		std::atomic_size_t remaining = 0;
+		std::coroutine_handle<> waiter = nullptr;
+		std::atomic_bool failed = false;
+		std::mutex exception_mutex;
+		std::exception_ptr exception;
+
+		static internal::GraphRoutine node_routine(TaskGraph* graph, Node* node) {
+			for (;;) {
+				size_t finished = 0;
+				Node* current = node;
+				while (current != nullptr) {
+					graph->execute(current);
+					finished++;
+
+					Node* next = nullptr;
+					for (auto successor : current->successors) {
+						if (successor->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+							continue;
+						}
+						// Every predecessor is done: the counter can be rearmed for the next run
+						successor->pending.store(successor->predecessors, std::memory_order_relaxed);
+						if (next == nullptr) {
+							next = successor;
+						} else {
+							ThreadPoolTaskScheduler::Schedule(successor->handle);
+						}
+					}
+					current = next;
+				}
+
+				co_await NodeFinished{graph, finished};
+			}
+		}
+
+		void execute(Node* node) {
+			if (failed.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			try {
+				node->work();
+			} catch (...) {
+				std::lock_guard lock(exception_mutex);
+				if (exception == nullptr) {
+					exception = std::current_exception();
+				}
+				failed.store(true, std::memory_order_relaxed);
+			}
+		}
+
+		void complete(size_t finished) {
+			if (remaining.fetch_sub(finished, std::memory_order_acq_rel) == finished) {
+				ThreadPoolTaskScheduler::Schedule(waiter);
+			}
+		}
+
+		void check_idle() const {
+			if (running.load(std::memory_order_acquire)) {
+				throw std::logic_error("TaskGraph cannot be modified while running");
+			}
+		}
+
+		// Finds the roots and rejects cycles, which would never complete
+		void prepare() {
+			if (!dirty) {
+				return;
+			}
+
+			roots.clear();
+			std::vector<Node*> ready;
+			for (auto& n : nodes) {
+				n->pending.store(n->predecessors, std::memory_order_relaxed);
+				if (n->predecessors == 0) {
+					roots.push_back(n.get());
+					ready.push_back(n.get());
+				}
+				if (n->handle == nullptr) {
+					n->handle = node_routine(this, n.get()).handle;
+				}
+			}
+
+			// Kahn's algorithm, borrowing the pending counters
+			size_t visited = 0;
+			while (!ready.empty()) {
+				auto n = ready.back();
+				ready.pop_back();
+				visited++;
+				for (auto s : n->successors) {
+					if (s->pending.fetch_sub(1, std::memory_order_relaxed) == 1) {
+						ready.push_back(s);
+					}
+				}
+			}
+
+			for (auto& n : nodes) {
+				n->pending.store(n->predecessors, std::memory_order_relaxed);
+			}
+			if (visited != nodes.size()) {
+				throw std::logic_error("TaskGraph contains a cycle");
+			}
+			dirty = false;
+		}
+
+	public:
+		TaskGraph() = default;
+		TaskGraph(const TaskGraph&) = delete;
+		TaskGraph& operator=(const TaskGraph&) = delete;
+
+		~TaskGraph() {
+			for (auto& n : nodes) {
+				if (n->handle != nullptr) {
+					n->handle.destroy();
+				}
+			}
+		}
+
+		void reserve(size_t count) {
+			nodes.reserve(count);
+		}
+
+		NodeId add(std::function<void()> work) {
+			check_idle();
+			nodes.push_back(std::make_unique<Node>(std::move(work)));
+			dirty = true;
+			return nodes.size() - 1;
+		}
+
+		// 'after' starts once 'before' has completed
+		void precede(NodeId before, NodeId after) {
+			check_idle();
+			if (before >= nodes.size() || after >= nodes.size()) {
+				throw std::out_of_range("Invalid TaskGraph node");
+			}
+			nodes[before]->successors.push_back(nodes[after].get());
+			nodes[after]->predecessors++;
+			dirty = true;
+		}
+
+		[[nodiscard]] size_t size() const {
+			return nodes.size();
+		}
+
+		/*
+		 * Runs every node once. The graph must outlive the returned task, and may only be run again
+		 * once it completed. It counts as running as soon as run() returns: it cannot be modified until then.
+		 */
+		Task<> run() {
+			if (running.exchange(true, std::memory_order_acq_rel)) {
+				throw std::logic_error("TaskGraph is already running");
+			}
+
+			try {
+				prepare();
+			} catch (...) {
+				running.store(false, std::memory_order_release);
+				throw;
+			}
+			return execute();
+		}
+
+	protected:
+		// Not a coroutine itself, run() marks the graph as running before returning: the body of a coroutine would only start on the pool
+		Task<> execute() {
+			if (!nodes.empty()) {
+				failed.store(false, std::memory_order_relaxed);
+				exception = nullptr;
+				remaining.store(nodes.size() + 1, std::memory_order_relaxed);
+				for (auto r : roots) {
+					ThreadPoolTaskScheduler::Schedule(r->handle);
+				}
+				co_await RunAwaiter{this};
+			}
+
+			auto e = exception;
+			running.store(false, std::memory_order_release);
+			if (e != nullptr) {
+				std::rethrow_exception(e);
+			}
+		}
+	};
+}
+
+#endif //COROUTINELIB_CC_TASK_GRAPH_H
@@ -0,0 +1,128 @@
+#ifndef COROUTINELIB_CC_TASK_GROUP_H
+#define COROUTINELIB_CC_TASK_GROUP_H
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+#include "cc_task.h"
+#include "cc_sync_utils.h"
+
+namespace crlib {
+	/*
+	 * Scope for child tasks: spawn() attaches running tasks to the group, and co_await group.join() waits for all of them.
+	 * Children can be spawned at any time, including by other children, until join() completes.
+	 * The first failing child, or cancel(), cancels the group: spawn() stops attaching new children, and running children
+	 * can poll is_cancelled() to stop early. join() rethrows the failure, or an AggregateException if several children failed.
+	 * Like a std::thread, a group must be joined before it is destroyed: destroying it with pending children terminates.
+	 */
+	class TaskGroup {
+	protected:
+		struct State {
+			WaitGroup pending;
+			std::atomic_bool cancelled;
+			std::atomic_bool failed;
+			std::mutex exceptions_mutex;
+			std::vector<std::exception_ptr> exceptions;
+
+			State() : cancelled(false), failed(false) {
+
+			}
+
+			void fail(std::exception_ptr e) {
+				{
+					std::lock_guard lock(exceptions_mutex);
+					exceptions.push_back(std::move(e));
+				}
+				failed.store(true, std::memory_order_release);
+			}
+		};
+
+		std::shared_ptr<State> state;
+
+	public:
+		TaskGroup() : state(std::make_shared<State>()) {
+
+		}
+
+		TaskGroup(const TaskGroup&) = delete;
+		TaskGroup& operator=(const TaskGroup&) = delete;
+
+		~TaskGroup() {
+			if (pending() != 0) {
+				// The children may still reference the group
+				std::terminate();
+			}
+		}
+
+		/*
+		 * Attaches task as a child, unless the group was cancelled. Returns whether it was attached: a task that
+		 * was not keeps running, and is up to the caller.
+		 */
+		template<HasLock TaskType>
+		requires EarlyLockable<typename TaskType::Lock> && ExceptionHolder<typename TaskType::Lock>
+		bool spawn(const TaskType& task) {
+			if (is_cancelled()) {
+				return false;
+			}
+			state->pending.add(1);
+			// The lock runs its callbacks while completing, so it outlives them
+			task.lock->append_coroutine([s = state, lock = task.lock.get()]() {
+				if (lock->exception != nullptr) {
+					s->fail(lock->exception);
+				}
+				s->pending.done();
+			});
+			return true;
+		}
+
+		// Starts factory() as a child, unless the group was cancelled. Returns whether the child was started.
+		template<typename Factory>
+		requires HasLock<std::invoke_result_t<Factory&>>
+		bool spawn(Factory factory) {
+			if (is_cancelled()) {
+				return false;
+			}
+			return spawn(factory());
+		}
+
+		void cancel() {
+			state->cancelled.store(true, std::memory_order_release);
+		}
+
+		[[nodiscard]] bool is_cancelled() const {
+			return state->cancelled.load(std::memory_order_acquire) || state->failed.load(std::memory_order_acquire);
+		}
+
+		// Amount of children that did not complete yet
+		[[nodiscard]] size_t pending() const {
+			return static_cast<size_t>(state->pending.pending());
+		}
+
+		/*
+		 * Completes once every child completed. Afterwards a failure no longer cancels the group, which can be reused;
+		 * a cancel() stays in effect.
+		 */
+		Task<> join() {
+			auto s = state;
+			co_await s->pending.wait();
+
+			std::vector<std::exception_ptr> exceptions;
+			{
+				std::lock_guard lock(s->exceptions_mutex);
+				exceptions.swap(s->exceptions);
+			}
+			s->failed.store(false, std::memory_order_release);
+
+			if (exceptions.size() == 1) {
+				std::rethrow_exception(exceptions[0]);
+			} else if (exceptions.size() > 1) {
+				throw AggregateException(std::move(exceptions));
+			}
+		}
+	};
+}
+
+#endif //COROUTINELIB_CC_TASK_GROUP_H
@@ -2,6 +2,8 @@
 #define COROUTINELIB_CC_TASK_LOCKS_H
 
 #include <semaphore>
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <functional>
 #include <optional>
@@ -20,12 +22,6 @@ namespace crlib {
 		a.append_coroutine(func);
 	};
 
-	template<typename T>
-	concept EarlyLockable = Lockable<T> && requires(T a) {
-		{ a.completed.load() } -> std::convertible_to<bool>;
-	};
-
-
 	template<typename T>
 	concept ValueHolder = requires(T a) {
 		a.returnValue;
@@ -36,35 +32,136 @@ namespace crlib {
 		a.exception;
 	};
 
+	namespace internal {
+		/*
+		 * Continuation waiting on a BaseLock. Awaiters embed one, so that awaiting a task allocates nothing;
+		 * append_coroutine() allocates one holding its function.
+		 */
+		struct LockWaiter {
+			LockWaiter* next = nullptr;
+			// Runs the continuation. The waiter may be destroyed as soon as it is called
+			void (*run)(LockWaiter*) = nullptr;
+			// Allocated by the lock, which deletes it if it is destroyed without completing
+			bool owned = false;
+		};
+
+		struct FunctionWaiter : public LockWaiter {
+			std::function<void()> function;
+
+			explicit FunctionWaiter(std::function<void()> f) : function(std::move(f)) {
+				run = [](LockWaiter* w) {
+					auto self = static_cast<FunctionWaiter*>(w);
+					self->function();
+					delete self;
+				};
+				owned = true;
+			}
+		};
+	}
+
+	// Locks that can be checked for completion, and take intrusive waiters
+	template<typename T>
+	concept EarlyLockable = Lockable<T> && requires(T a, internal::LockWaiter* w) {
+		{ a.is_completed() } -> std::convertible_to<bool>;
+		{ a.append(w) } -> std::convertible_to<bool>;
+	};
+
+	/*
+	 * Completion state of a task, in a single word: the completed bit, a bit set while a thread blocks in wait(),
+	 * and the waiters appended until then, as a lock-free stack. Blocking waits use C++20 atomic wait/notify.
+	 */
 	struct BaseLock {
-		std::atomic_bool completed;
-		default_queue<std::function<void()>> waiting_coroutines;
-		std::binary_semaphore wait_semaphore;
-		std::optional<std::exception_ptr> exception;
+		static constexpr uintptr_t completed_bit = 1;
+		static constexpr uintptr_t blocked_bit = 2;
+		static constexpr uintptr_t state_bits = completed_bit | blocked_bit;
+		static_assert(alignof(internal::LockWaiter) > state_bits);
 
-		BaseLock() : completed(false), wait_semaphore(0) {
+		std::atomic<uintptr_t> state;
+		// Null unless the task threw
+		std::exception_ptr exception;
 
+		BaseLock() : state(0) {
+
+		}
+
+		BaseLock(const BaseLock&) = delete;
+		BaseLock& operator=(const BaseLock&) = delete;
+
+		~BaseLock() {
+			auto s = state.load(std::memory_order_acquire);
+			if ((s & completed_bit) == 0) {
+				auto w = reinterpret_cast<internal::LockWaiter*>(s & ~state_bits);
+				while (w != nullptr) {
+					auto next = w->next;
+					if (w->owned) {
+						delete static_cast<internal::FunctionWaiter*>(w);
+					}
+					w = next;
+				}
+			}
+		}
+
+		[[nodiscard]] bool is_completed() const {
+			return (state.load(std::memory_order_acquire) & completed_bit) != 0;
 		}
 
 		void complete() {
-			completed.store(true);
-			wait_semaphore.release();
-			std::optional<std::function<void()>> h;
+			auto s = state.exchange(completed_bit, std::memory_order_acq_rel);
+			if ((s & blocked_bit) != 0) {
+				state.notify_all();
+			}
+
+			// The stack holds the newest waiter first: run them in the order they were appended
+			internal::LockWaiter* ordered = nullptr;
+			auto w = reinterpret_cast<internal::LockWaiter*>(s & ~state_bits);
+			while (w != nullptr) {
+				auto next = w->next;
+				w->next = ordered;
+				ordered = w;
+				w = next;
+			}
+			while (ordered != nullptr) {
+				auto next = ordered->next;
+				ordered->run(ordered);
+				ordered = next;
+			}
+		}
+
+		// Queues w, unless the lock already completed: returns false then, and w is left to the caller
+		bool append(internal::LockWaiter* w) {
+			auto s = state.load(std::memory_order_acquire);
 			do {
-				h = waiting_coroutines.pull();
-				if (h.has_value()) {
-					h.value()();
+				if ((s & completed_bit) != 0) {
+					return false;
 				}
-
-			} while (h.has_value());
+				w->next = reinterpret_cast<internal::LockWaiter*>(s & ~state_bits);
+			} while (!state.compare_exchange_weak(s, reinterpret_cast<uintptr_t>(w) | (s & blocked_bit),
+				std::memory_order_release, std::memory_order_acquire));
+			return true;
 		}
 
 		void append_coroutine(std::function<void()> f) {
-			if (completed.load()) {
+			if (is_completed()) {
 				f();
 				return;
 			}
-			waiting_coroutines.push(f);
+
+			auto w = new internal::FunctionWaiter(std::move(f));
+			if (!append(w)) {
+				w->run(w);
+			}
+		}
+
+		// Blocks the calling thread until complete() is called
+		void wait_completed() {
+			auto s = state.load(std::memory_order_acquire);
+			while ((s & completed_bit) == 0) {
+				if ((s & blocked_bit) == 0 && !state.compare_exchange_weak(s, s | blocked_bit, std::memory_order_acquire)) {
+					continue;
+				}
+				state.wait(s | blocked_bit, std::memory_order_acquire);
+				s = state.load(std::memory_order_acquire);
+			}
 		}
 	};
 
@@ -76,16 +173,22 @@ namespace crlib {
 		bool completed;
 		std::optional<std::function<void()>> waiting_coroutine;
 		std::atomic_bool has_awaiter;
+		// Set by both add_awaiter() and complete(): whichever comes second runs the awaiter
+		std::atomic_bool handoff;
 		std::optional<std::exception_ptr> exception;
 
-		Single_Awaitable_Task_lock() : has_value(false), has_awaiter(false), completed(false) {
+		Single_Awaitable_Task_lock() : has_value(false), completed(false), has_awaiter(false), handoff(false) {
 
 		}
 
 		bool add_awaiter(std::function<void()> awaiter) {
 			bool v = false;
-			if (has_awaiter.compare_exchange_weak(v, true)) {
-				waiting_coroutine = awaiter;
+			if (has_awaiter.compare_exchange_strong(v, true)) {
+				waiting_coroutine = std::move(awaiter);
+				// The task may have completed before there was anything to resume
+				if (handoff.exchange(true)) {
+					waiting_coroutine.value()();
+				}
 				return true;
 			}
 
@@ -101,7 +204,7 @@ namespace crlib {
 
 		void complete() {
 			completed = true;
-			if (waiting_coroutine.has_value()) {
+			if (handoff.exchange(true)) {
 				auto c = waiting_coroutine.value();
 				c();
 			}
@@ -118,12 +221,10 @@ namespace crlib {
 		}
 
 		T wait() requires NotVoid<T> {
-			if (!completed) {
-				wait_semaphore.acquire();
-			}
+			wait_completed();
 
-			if (exception.has_value()) {
-				std::rethrow_exception(exception.value());
+			if (exception != nullptr) {
+				std::rethrow_exception(exception);
 			}
 
 			if (!returnValue.has_value()) {
@@ -145,12 +246,10 @@ namespace crlib {
 		Task_lock() = default;
 
 		void wait() {
-			if (!completed) {
-				wait_semaphore.acquire();
-			}
+			wait_completed();
 
-			if (exception.has_value()) {
-				std::rethrow_exception(exception.value());
+			if (exception != nullptr) {
+				std::rethrow_exception(exception);
 			}
 		}
 	};
@@ -163,6 +262,7 @@ namespace crlib {
 		std::atomic<std::function<void()>*> generator_waiter;
 		std::optional<std::exception_ptr> exception;
 		std::atomic_bool completed = std::atomic_bool(false);
+		std::atomic_bool stopping = std::atomic_bool(false);
 
 		std::optional<T> wait() {
 			auto waiting_val = std::make_shared<std::optional<T>>();
@@ -172,7 +272,7 @@ namespace crlib {
 			if (waiting_queue.push([weak_semaphore, weak_val](std::optional<T> value) -> void {
 				auto strong_val = weak_val.lock();
 				if (strong_val != nullptr) {
-					strong_val.swap(value);
+					strong_val->swap(value);
 				}
 
 				auto strong_semaphore = weak_semaphore.lock();
@@ -180,6 +280,7 @@ namespace crlib {
 					strong_semaphore->release();
 				}
 			})) {
+				wake();
 				wait_semaphore->acquire();
 				return *waiting_val;
 			}
@@ -204,6 +305,17 @@ namespace crlib {
 			}
 		}
 
+		// Makes the generator unwind from its next co_yield, so that its frame is freed without being consumed to the end
+		void stop() {
+			if (stopping.exchange(true) || completed.load()) {
+				return;
+			}
+
+			// Stands for a consumer, which resumes the generator if it is already waiting at a co_yield
+			waiting_queue.push([](std::optional<T>) {});
+			wake();
+		}
+
 		void complete() {
 
 			completed.store(true);
@@ -1,13 +1,22 @@
 #pragma once
 #include <coroutine>
+#include <concepts>
 #include <thread>
 #include <memory>
 #include <optional>
+#include <atomic>
+#include <deque>
+#include <mutex>
 #include "cc_api.h"
 #include "cc_thread_pool.h"
 
 #define CRLIB_DEFAULT_THREAD_POOL_THREADS 8U
 
+// Continuations resumed inline, nested in the resume of the task they awaited, before falling back to a submit
+#ifndef CRLIB_MAX_INLINE_RESUME_DEPTH
+#define CRLIB_MAX_INLINE_RESUME_DEPTH 32
+#endif
+
 namespace crlib {
 template<typename T>
 concept IsTaskScheduler = requires(T scheduler, std::coroutine_handle<> h) {
@@ -23,9 +32,49 @@ concept InlineableTaskScheduler = IsTaskScheduler<T> && requires() {
 
 
 struct BaseTaskScheduler {
+	/*
+	 * Created on first use, unless set before, and then never destroyed: its workers keep running until the process exits.
+	 * Replace it only while nothing is being scheduled.
+	 */
     CRLIB_API static std::shared_ptr<BaseTaskScheduler> default_task_scheduler;
-	thread_local static  std::shared_ptr<BaseTaskScheduler> current_scheduler;
-    CRLIB_API static void Schedule(std::coroutine_handle<> handle);
+
+	/*
+	 * Inline, so that scheduling onto a thread pool compiles down to ThreadPool::submit(), without a virtual call
+	 * (see Submit()). Other schedulers get their OnTaskSubmitted() called.
+	 */
+	static void Schedule(std::coroutine_handle<> handle) {
+		auto scheduler = Current();
+		if (scheduler == nullptr) {
+			scheduler = Default();
+		}
+		scheduler->Submit(handle);
+	}
+
+	/*
+	 * Scheduler owning the calling thread: schedulers set it on their own threads, Schedule() submits to it.
+	 * A DLL cannot share the thread_local itself with its users: on Windows, Current() is an exported function.
+	 */
+#ifdef _WIN32
+	CRLIB_API static BaseTaskScheduler* Current();
+#else
+	static BaseTaskScheduler* Current() {
+		return current_scheduler;
+	}
+#endif
+	CRLIB_API static void SetCurrent(BaseTaskScheduler* scheduler);
+
+	static BaseTaskScheduler* Default() {
+		if (!default_ready.load(std::memory_order_acquire)) [[unlikely]] {
+			InitDefault();
+		}
+		return default_task_scheduler.get();
+	}
+
+	/*
+	 * Resumes handle on home. With allow_inline, a thread already belonging to home resumes it right away,
+	 * instead of submitting it back to the scheduler it is running on.
+	 */
+	CRLIB_API static void ResumeOn(BaseTaskScheduler* home, std::coroutine_handle<> handle, bool allow_inline);
 	CRLIB_API constexpr static bool CanInline() {
 		return false;
 	}
@@ -35,6 +84,32 @@ struct BaseTaskScheduler {
 
 
     CRLIB_API virtual void OnTaskSubmitted(std::coroutine_handle<> handle) = 0;
+
+	void Submit(std::coroutine_handle<> handle) {
+		CC_OBSERVE(observer, on_submit(handle));
+		if (pool != nullptr) {
+			pool->submit(handle);
+		} else {
+			OnTaskSubmitted(handle);
+		}
+	}
+
+	/*
+	 * Installs observer (null to remove it). Schedule() reports the submits it hands to this scheduler:
+	 * schedulers with more events to report (like ThreadPoolTaskScheduler) override this to install it where they happen.
+	 */
+	CRLIB_API virtual void set_observer(std::shared_ptr<SchedulerObserver> observer, bool account_cpu_time = false);
+
+protected:
+	constinit thread_local static BaseTaskScheduler* current_scheduler;
+#ifdef CRLIB_OBSERVERS
+	internal::ObserverSlot observer;
+#endif
+	// Set by schedulers whose OnTaskSubmitted() only submits to this pool, which Submit() then calls directly
+	ThreadPool* pool = nullptr;
+
+	CRLIB_API static std::atomic_bool default_ready;
+	CRLIB_API static void InitDefault();
 };
 
 struct ThreadPoolTaskScheduler : public BaseTaskScheduler {
@@ -43,8 +118,131 @@ struct ThreadPoolTaskScheduler : public BaseTaskScheduler {
     CRLIB_API ThreadPoolTaskScheduler();
     CRLIB_API ThreadPoolTaskScheduler(size_t thread_amount);
 
-    CRLIB_API virtual void OnTaskSubmitted(std::coroutine_handle<> handle) override;
-	CRLIB_API ~ThreadPoolTaskScheduler() override = default;
+    // Final, as Submit() bypasses it
+    CRLIB_API void OnTaskSubmitted(std::coroutine_handle<> handle) final;
+	CRLIB_API void set_observer(std::shared_ptr<SchedulerObserver> observer, bool account_cpu_time = false) override;
+	CRLIB_API ~ThreadPoolTaskScheduler() override;
+};
+
+namespace internal {
+	/*
+	 * Marks a coroutine as suspending on this thread while its awaiter publishes a continuation. A continuation running
+	 * right away must not resume the coroutine from inside its own await_suspend: it claims the resume with defer(),
+	 * and the awaiter then returns suspend(), false, to let the coroutine go on.
+	 */
+	struct SuspendScope {
+		void* handle;
+		SuspendScope* previous;
+		bool resumed;
+
+		CRLIB_API explicit SuspendScope(std::coroutine_handle<> h);
+		CRLIB_API ~SuspendScope();
+
+		SuspendScope(const SuspendScope&) = delete;
+		SuspendScope& operator=(const SuspendScope&) = delete;
+
+		[[nodiscard]] bool suspend() const {
+			return !resumed;
+		}
+
+		// True if h is suspending on this thread: the resume is then left to its awaiter
+		CRLIB_API static bool defer(std::coroutine_handle<> h);
+	};
+
+	// A suspended coroutine, and the scheduler it was running on when it suspended
+	template<IsTaskScheduler Scheduler>
+	struct Continuation {
+		std::coroutine_handle<> handle;
+		BaseTaskScheduler* home;
+
+		explicit Continuation(std::coroutine_handle<> handle) : handle(handle), home(nullptr) {
+			if constexpr (std::derived_from<Scheduler, BaseTaskScheduler>) {
+				home = BaseTaskScheduler::Current();
+			}
+		}
+
+		Continuation(std::coroutine_handle<> handle, BaseTaskScheduler* home) : handle(handle), home(home) {
+
+		}
+
+		// Schedulers not derived from BaseTaskScheduler have no instance to go back to, their static Schedule() decides
+		void resume(bool allow_inline = false) const {
+			if (home != nullptr) {
+				BaseTaskScheduler::ResumeOn(home, handle, allow_inline);
+			} else {
+				Scheduler::Schedule(handle);
+			}
+		}
+	};
+}
+
+/*
+ * Single threaded run loop, for thread-per-core designs. It belongs to the thread constructing it, which it becomes
+ * the current scheduler of, and runs the coroutines submitted to it whenever that thread calls run(), run_until() or poll().
+ * Submits from the loop's own thread go to a plain local queue, without atomics; other threads push to a lock-free
+ * inbox, and wake the loop up if it is sleeping. An idle loop blocks on an eventfd (a condition variable outside Linux).
+ * Construct and destroy it on the same thread.
+ */
+struct EventLoopScheduler : public BaseTaskScheduler {
+protected:
+	BaseTaskScheduler* previous_scheduler;
+	std::deque<std::coroutine_handle<>> local_tasks;
+	default_queue<std::coroutine_handle<>> inbox;
+	std::atomic_bool sleeping;
+	std::atomic_bool stopping;
+#ifdef __linux__
+	int wake_fd;
+#else
+	std::mutex wake_mutex;
+	std::condition_variable wake_variable;
+	bool woken;
+#endif
+
+	void wake();
+	void sleep();
+
+public:
+	CRLIB_API EventLoopScheduler();
+	CRLIB_API ~EventLoopScheduler() override;
+
+	EventLoopScheduler(const EventLoopScheduler&) = delete;
+	EventLoopScheduler& operator=(const EventLoopScheduler&) = delete;
+
+	CRLIB_API void OnTaskSubmitted(std::coroutine_handle<> handle) override;
+
+	// Resumes the coroutines ready now (not the ones they submit in turn) and returns how many
+	CRLIB_API size_t poll();
+	// Resumes coroutines, sleeping while there are none, until stop() is called
+	CRLIB_API void run();
+	// Makes the running run() return, or the next one if none is running. Can be called from any thread
+	CRLIB_API void stop();
+
+	// Runs the loop until task completes, then returns its result
+	template<typename TaskType>
+	decltype(auto) run_until(TaskType task) {
+		auto lock = task.lock;
+		lock->append_coroutine([this]() {
+			stop();
+		});
+		run();
+		return task.wait();
+	}
+};
+
+/*
+ * Runs tasks on the thread creating them, right away, and resumes them on whichever thread completes what they await.
+ * Nested resumes past CRLIB_MAX_INLINE_RESUME_DEPTH are queued, and run as soon as the outer ones return.
+ */
+struct InlineScheduler {
+	CRLIB_API static void Schedule(std::coroutine_handle<> handle);
+
+	constexpr static bool CanInline() {
+		return true;
+	}
+
+	void OnTaskSubmitted(std::coroutine_handle<> handle) {
+		Schedule(handle);
+	}
 };
 
 }
\ No newline at end of file
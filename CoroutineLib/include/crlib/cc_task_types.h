@@ -68,6 +68,11 @@ namespace crlib {
 		std::optional<T> wait() {
 			return lock->wait();
 		}
+
+		// Stops the generator at its next co_yield: every consumer, including this one, then receives std::nullopt
+		void stop() {
+			lock->stop();
+		}
 	};
 
 	template<NotVoid T, IsTaskScheduler SchedulerType = ThreadPoolTaskScheduler>
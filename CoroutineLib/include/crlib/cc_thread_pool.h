@@ -1,5 +1,7 @@
 #pragma once
 #include <memory>
+#include <atomic>
+#include <chrono>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -7,10 +9,14 @@
 #include <coroutine>
 #include <vector>
 #include <queue>
+#include <functional>
 #include <iostream>
 #include "cc_api.h"
 #include "cc_dictionary.h"
 #include "cc_queue_config.h"
+#include "cc_trace.h"
+#include "cc_histogram.h"
+#include "cc_scheduler_observer.h"
 
 namespace crlib {
 
@@ -20,36 +26,80 @@ struct ThreadPool_Thread;
 #define CRLIB_LOCAL_QUEUE_SIZE 1024
 #endif
 
+// By default, the scheduling delay of one submitted coroutine in this many is measured
+#ifndef CRLIB_SCHEDULING_DELAY_SAMPLING
+#define CRLIB_SCHEDULING_DELAY_SAMPLING 64
+#endif
+
+struct ScheduledHandle {
+	std::coroutine_handle<> handle;
+	// steady_clock time of submit() in nanoseconds, 0 when not sampled
+	uint64_t submitted;
+};
+
 struct ThreadPool {
+	friend ThreadPool_Thread;
 public:
-	static thread_local std::shared_ptr<ThreadPool_Thread> local_thread;
-	using Queue_t = default_queue<std::coroutine_handle<>>;
-	using QueuePtr = std::shared_ptr<default_queue<std::coroutine_handle<>>>;
+	// Set by the worker while it runs, which keeps itself alive until then
+	static constinit thread_local ThreadPool_Thread* local_thread;
+	using Queue_t = default_queue<ScheduledHandle>;
+	using QueuePtr = std::shared_ptr<default_queue<ScheduledHandle>>;
 private:
 
 	std::mutex task_added_mutex;
 	std::condition_variable task_added_variable;
 	std::vector<std::shared_ptr<ThreadPool_Thread>> threads;
 	ConcurrentDictionary<std::thread::id, QueuePtr> queues;
-	default_queue<std::coroutine_handle<>> global_tasks_queue;
-	bool running;
+	default_queue<ScheduledHandle> global_tasks_queue;
+	std::atomic_bool running;
+	std::atomic<uint32_t> delay_sampling;
+#ifdef CRLIB_OBSERVERS
+	internal::ObserverSlot observer;
+#endif
+	// Run by every worker before it starts resuming coroutines
+	std::function<void()> thread_init;
 	std::weak_ptr<ThreadPool> self_ptr;
 
 	CRLIB_API ThreadPool();
 public:
-	CRLIB_API static std::shared_ptr<ThreadPool> build(size_t thread_count);
+	CRLIB_API static std::shared_ptr<ThreadPool> build(size_t thread_count, std::function<void()> thread_init = nullptr);
 	CRLIB_API ~ThreadPool();
 
-	CRLIB_API void submit(std::coroutine_handle<> h);
+	// Inline, see below
+	void submit(std::coroutine_handle<> h);
+	// Worker running on the calling thread, null outside of any pool. Exported on Windows, a DLL cannot share local_thread itself
+#ifdef _WIN32
+	CRLIB_API static ThreadPool_Thread* local();
+#else
+	static ThreadPool_Thread* local() {
+		return local_thread;
+	}
+#endif
 	CRLIB_API void register_queue(std::thread::id id, QueuePtr queue);
 
 	CRLIB_API bool is_running() {
 		return this->running;
 	}
 
-	CRLIB_API std::optional<std::coroutine_handle<>> get_work();
+	CRLIB_API std::optional<ScheduledHandle> get_work();
 
 	CRLIB_API void stop();
+
+	/*
+	 * Submit-to-resume delay: the time coroutines spend queued before a worker resumes them.
+	 * Only one submit() in every sampling is timed (0 disables the measure), and every worker records
+	 * the delays it sees in its own histogram, in nanoseconds.
+	 */
+	CRLIB_API void set_scheduling_delay_sampling(uint32_t sampling);
+	// Adds every worker's histogram to into
+	CRLIB_API void merge_scheduling_delay(LatencyHistogram& into);
+	CRLIB_API void reset_scheduling_delay();
+
+	/*
+	 * Installs observer (null to remove it) to receive this pool's submit, resume, steal and park events.
+	 * With account_cpu_time, the thread CPU time of every resume is measured and passed to on_resume_end.
+	 */
+	CRLIB_API void set_observer(std::shared_ptr<SchedulerObserver> observer, bool account_cpu_time = false);
 };
 
 struct ThreadPool_Thread {
@@ -59,10 +109,22 @@ private:
 	std::shared_ptr<ThreadPool> thread_pool;
 	std::unique_ptr<std::thread> self;
 	ThreadPool::QueuePtr local_tasks;
+	LatencyHistogram scheduling_delay;
+
+	void resume(std::coroutine_handle<> h) {
+#ifdef CRLIB_OBSERVERS
+		thread_pool->observer.resume(h);
+#else
+		h.resume();
+#endif
+	}
 
 	void run(std::shared_ptr<ThreadPool_Thread> self_ptr) {
-		ThreadPool::local_thread = self_ptr;
+		ThreadPool::local_thread = self_ptr.get();
 		thread_pool->register_queue(std::this_thread::get_id(), local_tasks);
+		if (thread_pool->thread_init) {
+			thread_pool->thread_init();
+		}
 		
 		do {
 			auto h = local_tasks->pull();
@@ -71,7 +133,14 @@ private:
 			}
 
 			if (h.has_value()) {
-				h.value().resume();
+				if (h->submitted != 0) {
+					auto now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+					scheduling_delay.record(now > h->submitted ? now - h->submitted : 0);
+				}
+
+				CC_TRACE(Resume, h->handle.address());
+				resume(h->handle);
+				CC_TRACE(Suspend, h->handle.address());
 			}
 		} while (thread_pool->is_running());
 
@@ -91,4 +160,35 @@ private:
 	}
 };
 
+inline void ThreadPool::submit(std::coroutine_handle<> h) {
+	// Counts submits from the current thread, to sample one in every delay_sampling (one count per module in DLL builds)
+	static thread_local uint32_t submit_count = 0;
+
+	CC_TRACE(Schedule, h.address());
+	CC_OBSERVE(observer, on_submit(h));
+	ScheduledHandle scheduled { h, 0 };
+	auto sampling = delay_sampling.load(std::memory_order_relaxed);
+	if (sampling != 0 && ++submit_count >= sampling) {
+		submit_count = 0;
+		scheduled.submitted = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	auto worker = local();
+	if (worker != nullptr && worker->thread_pool.get() == this) {
+		// Only its worker pushes to its local queue
+		if (worker->local_tasks->push_single_producer(scheduled)) {
+			// Idle workers only look for work to steal when woken up
+			task_added_variable.notify_one();
+			return;
+		}
+	}
+
+	global_tasks_queue.push(scheduled);
+
+	{
+		std::lock_guard lock(task_added_mutex);
+		task_added_variable.notify_all();
+	}
+}
+
 }
\ No newline at end of file
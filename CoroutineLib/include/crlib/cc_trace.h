@@ -0,0 +1,51 @@
+#ifndef COROUTINELIB_CC_TRACE_H
+#define COROUTINELIB_CC_TRACE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "cc_api.h"
+
+#ifndef CRLIB_TRACE_BUFFER_SIZE
+#define CRLIB_TRACE_BUFFER_SIZE 65536
+#endif
+
+namespace crlib {
+	enum class TraceEvent : uint8_t {
+		Create,
+		Schedule,
+		Resume,
+		Suspend,
+		Await,
+		Complete,
+		Steal,
+		Park,
+		Unpark
+	};
+
+	/*
+	 * Task lifecycle tracing, compiled in by defining CRLIB_TRACING (the CRLIB_TRACING CMake option).
+	 * Every thread records its events in its own ring buffer of CRLIB_TRACE_BUFFER_SIZE entries, without locks:
+	 * only the most recent events are kept. Tasks are identified by the address of their coroutine frame.
+	 * The buffers can be dumped at any time as Chrome trace-event JSON, which chrome://tracing and ui.perfetto.dev open.
+	 */
+	struct Trace {
+		CRLIB_API static void record(TraceEvent event, const void* task, const void* detail = nullptr);
+		CRLIB_API static void set_enabled(bool enabled);
+		CRLIB_API static bool is_enabled();
+		// Forgets every event recorded so far
+		CRLIB_API static void clear();
+		CRLIB_API static void write_chrome_json(std::ostream& out);
+		CRLIB_API static bool write_chrome_json(const std::string& path);
+	};
+}
+
+#ifdef CRLIB_TRACING
+#define CC_TRACE(event, task) crlib::Trace::record(crlib::TraceEvent::event, task)
+#define CC_TRACE2(event, task, detail) crlib::Trace::record(crlib::TraceEvent::event, task, detail)
+#else
+#define CC_TRACE(event, task)
+#define CC_TRACE2(event, task, detail)
+#endif
+
+#endif //COROUTINELIB_CC_TRACE_H
@@ -12,6 +12,12 @@ namespace crlib {
 template<crlib::NotVoid T, typename ... Args>
 struct std::coroutine_traits<crlib::ValueTask<T>, Args...> {
 struct promise_type : public crlib::BasePromise<crlib::ValueTask<T>, crlib::Single_Awaitable_Task_lock<T>> {
+#ifdef CRLIB_INSPECTOR
+	promise_type(std::source_location location = std::source_location::current()) : promise_type::BasePromise(location) {
+
+	}
+#endif
+
 	void return_value(T value) {
 		this->lock->set_result(std::move(value));
 	}
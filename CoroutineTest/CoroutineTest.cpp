@@ -4,7 +4,20 @@
 #include <iostream>
 #include "crlib/cc_task.h"
 #include <sstream>
+#include <deque>
 #include <crlib/cc_sync_utils.h>
+#include <crlib/cc_dictionary.h>
+#include <crlib/cc_flat_dictionary.h>
+#include <crlib/cc_async_cache.h>
+#include <crlib/cc_parallel.h>
+#include <crlib/cc_task_graph.h>
+#include <crlib/cc_task_group.h>
+#include <crlib/cc_trace.h>
+#include <crlib/cc_inspector.h>
+#include <crlib/cc_histogram.h>
+#include <crlib/cc_scheduler_observer.h>
+#include <crlib/cc_generator_adapters.h>
+#include <crlib/cc_generator.h>
 
 using namespace crlib;
 
@@ -63,7 +76,7 @@ bool test_async_mutex() {
 
 	for(int i = 0; i < 16; i++) {
 		int ix = i + 1;
-		tasks.push_back(([&mutex, &flag, &ok](int ix) -> Task<> {
+		tasks.push_back(([](AsyncMutex& mutex, std::atomic_bool& flag, std::atomic_bool& ok, int ix) -> Task<> {
 			std::stringstream ss;
 
 			ss << ix << " Coroutine Started" << std::endl;
@@ -90,7 +103,7 @@ bool test_async_mutex() {
 			ss << ix << " Coroutine Out" << std::endl;
 			std::cout << ss.str();
 			ss.str("");
-		})(ix));
+		})(mutex, flag, ok, ix));
 	}
 
 
@@ -101,6 +114,1444 @@ bool test_async_mutex() {
 	return ok.load();
 }
 
+GeneratorTask<int> Counter_coroutine(int amount) {
+	for (int i = 0; i < amount; i++) {
+		co_yield i;
+	}
+}
+
+GeneratorTask<int> endless_coroutine(std::shared_ptr<int> alive) {
+	for (int i = 0;; i++) {
+		co_yield i;
+	}
+}
+
+bool test_generator_adapters() {
+	GeneratorTask<std::vector<int>> chunks = Counter_coroutine(100)
+			| crlib::map([](int v) { return v * 3; })
+			| crlib::filter([](int v) { return v % 2 == 0; })
+			| crlib::take(7)
+			| crlib::chunk(3);
+
+	auto ok = ([chunks]() -> Task<bool> {
+		std::vector<std::vector<int>> expected {{0, 6, 12}, {18, 24, 30}, {36}};
+		std::vector<std::vector<int>> received;
+
+		auto c = co_await chunks;
+		while (c.has_value()) {
+			received.push_back(c.value());
+			c = co_await chunks;
+		}
+
+		if (received != expected) {
+			std::cerr << "[GeneratorAdapters] Unexpected pipeline output" << std::endl;
+			co_return false;
+		}
+		co_return true;
+	})().wait();
+	if (!ok) {
+		return false;
+	}
+
+	// take() stops an endless source once it has enough values, which frees its frame
+	auto alive = std::make_shared<int>(0);
+	std::weak_ptr<int> source_alive = alive;
+	GeneratorTask<int> first = endless_coroutine(std::move(alive)) | crlib::take(3);
+	int count = 0;
+	while (first.wait().has_value()) {
+		count++;
+	}
+	for (int i = 0; i < 1000 && !source_alive.expired(); i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	if (count != 3 || !source_alive.expired()) {
+		std::cerr << "[GeneratorAdapters] Source still alive after take(), " << count << " values" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+Task<int> ready_value(int value) {
+	co_return value;
+}
+
+Task<> consume_all(GeneratorTask<int> gen, std::atomic_int& received, std::atomic<int64_t>& total) {
+	auto v = co_await gen;
+	while (v.has_value()) {
+		received++;
+		total += v.value();
+		v = co_await gen;
+	}
+}
+
+/*
+ * Awaited tasks complete on other workers while the awaiting coroutine is still suspending: it may be resumed, and its
+ * frame holding the awaiter destroyed, before await_suspend() returns. Best run under AddressSanitizer as well.
+ */
+bool test_await_lifetime() {
+	for (int i = 0; i < 2000; i++) {
+		auto sum = ([](int i) -> Task<int> {
+			auto single = ready_value(i);
+			auto value = co_await single;
+
+			std::vector<Task<int>> parts {ready_value(1), ready_value(2), ready_value(3)};
+			auto all = WhenAll<Task<int>>(parts);
+			co_await all;
+			co_return value + parts[0].wait() + parts[1].wait() + parts[2].wait();
+		})(i).wait();
+		if (sum != i + 6) {
+			std::cerr << "[AwaitLifetime] Unexpected sum " << sum << std::endl;
+			return false;
+		}
+	}
+
+	// Consumers queued while the generator publishes its waiter must still be resumed, or this hangs
+	for (int run = 0; run < 20; run++) {
+		auto gen = Counter_coroutine(2000);
+		std::atomic_int received(0);
+		std::atomic<int64_t> total(0);
+		std::vector<Task<>> consumers;
+		for (int c = 0; c < 8; c++) {
+			consumers.push_back(consume_all(gen, received, total));
+		}
+		([&consumers]() -> Task<> {
+			co_await WhenAll(consumers);
+		})().wait();
+
+		if (received.load() != 2000 || total.load() != 1999 * 2000 / 2) {
+			std::cerr << "[AwaitLifetime] Consumers received " << received.load() << " values" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool test_async_mutex_lock() {
+	AsyncMutex mutex;
+	int counter = 0;
+	std::vector<Task<>> tasks;
+
+	for (int i = 0; i < 32; i++) {
+		tasks.push_back(([](AsyncMutex& mutex, int& counter, bool spin) -> Task<> {
+			for (int j = 0; j < 1000; j++) {
+				if (spin) {
+					auto guard = co_await mutex.lock_or_spin();
+					counter++;
+				} else {
+					auto guard = co_await mutex.lock();
+					counter++;
+				}
+			}
+		})(mutex, counter, i % 2 == 0));
+	}
+
+	([&tasks]() -> Task<> {
+		co_await WhenAll(tasks);
+	})().wait();
+
+	if (counter != 32 * 1000) {
+		std::cerr << "[AsyncMutex] Lost updates: " << counter << std::endl;
+		return false;
+	}
+
+	if (!mutex.try_lock()) {
+		std::cerr << "[AsyncMutex] Mutex still locked after all guards were released" << std::endl;
+		return false;
+	}
+	bool locked_twice = mutex.try_lock();
+	mutex.unlock();
+
+	return !locked_twice;
+}
+
+bool test_async_shared_mutex() {
+	AsyncSharedMutex mutex;
+	std::atomic_int active_readers(0);
+	std::atomic_int active_writers(0);
+	std::atomic_bool ok(true);
+	int a = 0, b = 0;
+	std::vector<Task<>> tasks;
+
+	for (int i = 0; i < 8; i++) {
+		tasks.push_back(([](AsyncSharedMutex& mutex, std::atomic_int& readers, std::atomic_int& writers, std::atomic_bool& ok, int& a, int& b) -> Task<> {
+			for (int j = 0; j < 500; j++) {
+				auto guard = co_await mutex.lock();
+				if (writers.fetch_add(1) != 0 || readers.load() != 0) {
+					ok.store(false);
+				}
+				a++;
+				b++;
+				writers.fetch_sub(1);
+			}
+		})(mutex, active_readers, active_writers, ok, a, b));
+	}
+
+	for (int i = 0; i < 32; i++) {
+		tasks.push_back(([](AsyncSharedMutex& mutex, std::atomic_int& readers, std::atomic_int& writers, std::atomic_bool& ok, int& a, int& b) -> Task<> {
+			for (int j = 0; j < 500; j++) {
+				auto guard = co_await mutex.lock_shared();
+				readers.fetch_add(1);
+				if (writers.load() != 0 || a != b) {
+					ok.store(false);
+				}
+				readers.fetch_sub(1);
+			}
+		})(mutex, active_readers, active_writers, ok, a, b));
+	}
+
+	([&tasks]() -> Task<> {
+		co_await WhenAll(tasks);
+	})().wait();
+
+	if (!ok.load() || a != 8 * 500 || b != 8 * 500) {
+		std::cerr << "[AsyncSharedMutex] Exclusion violated" << std::endl;
+		return false;
+	}
+
+	return mutex.try_lock();
+}
+
+bool test_async_semaphore() {
+	AsyncSemaphore semaphore(4);
+	std::atomic_int in_use(0);
+	std::atomic_bool ok(true);
+	std::vector<Task<>> tasks;
+
+	for (int i = 0; i < 64; i++) {
+		tasks.push_back(([](AsyncSemaphore& semaphore, std::atomic_int& in_use, std::atomic_bool& ok, size_t count) -> Task<> {
+			for (int j = 0; j < 100; j++) {
+				auto permit = co_await semaphore.acquire(count);
+				if (in_use.fetch_add(static_cast<int>(count)) + static_cast<int>(count) > 4) {
+					ok.store(false);
+				}
+				std::this_thread::yield();
+				in_use.fetch_sub(static_cast<int>(count));
+			}
+		})(semaphore, in_use, ok, i % 8 == 0 ? 3 : 1));
+	}
+
+	([&tasks]() -> Task<> {
+		co_await WhenAll(tasks);
+	})().wait();
+
+	if (!ok.load()) {
+		std::cerr << "[AsyncSemaphore] Too many permits handed out" << std::endl;
+		return false;
+	}
+
+	if (semaphore.available() != 4 || !semaphore.try_acquire(4) || semaphore.try_acquire()) {
+		std::cerr << "[AsyncSemaphore] Permits were not all returned" << std::endl;
+		return false;
+	}
+	semaphore.release(4);
+
+	return true;
+}
+
+bool test_async_condition_variable() {
+	constexpr int producers = 4;
+	constexpr int consumers = 4;
+	constexpr int items = 2000;
+
+	AsyncMutex mutex;
+	AsyncConditionVariable cv;
+	std::deque<int> queue;
+	int finished_producers = 0;
+	std::atomic<long> sum(0);
+	std::vector<Task<>> tasks;
+
+	for (int c = 0; c < consumers; c++) {
+		tasks.push_back(([](AsyncMutex& mutex, AsyncConditionVariable& cv, std::deque<int>& queue, int& finished_producers, std::atomic<long>& sum) -> Task<> {
+			while (true) {
+				auto guard = co_await mutex.lock();
+				co_await cv.wait(guard, [&]() { return !queue.empty() || finished_producers == producers; });
+				if (!guard.owns_lock()) {
+					throw std::runtime_error("Woke up without the mutex");
+				}
+				if (queue.empty()) {
+					break;
+				}
+				sum.fetch_add(queue.front());
+				queue.pop_front();
+			}
+		})(mutex, cv, queue, finished_producers, sum));
+	}
+
+	for (int p = 0; p < producers; p++) {
+		tasks.push_back(([](AsyncMutex& mutex, AsyncConditionVariable& cv, std::deque<int>& queue, int& finished_producers) -> Task<> {
+			for (int i = 1; i <= items; i++) {
+				auto guard = co_await mutex.lock();
+				queue.push_back(i);
+				cv.notify_one();
+			}
+
+			auto guard = co_await mutex.lock();
+			finished_producers++;
+			cv.notify_all();
+		})(mutex, cv, queue, finished_producers));
+	}
+
+	for (auto& t : tasks) {
+		t.wait();
+	}
+
+	long expected = static_cast<long>(producers) * items * (items + 1) / 2;
+	if (sum.load() != expected) {
+		std::cerr << "[AsyncConditionVariable] Expected sum " << expected << ", got " << sum.load() << std::endl;
+		return false;
+	}
+
+	// Waiters without a mutex
+	std::atomic_int signaled(0);
+	std::vector<Task<>> signal_waiters;
+	for (int i = 0; i < 8; i++) {
+		signal_waiters.push_back(([](AsyncConditionVariable& cv, std::atomic_int& signaled) -> Task<> {
+			co_await cv.await();
+			signaled.fetch_add(1);
+		})(cv, signaled));
+	}
+	while (signaled.load() < 8) {
+		cv.notify_all();
+		std::this_thread::yield();
+	}
+	for (auto& t : signal_waiters) {
+		t.wait();
+	}
+
+	return true;
+}
+
+template<typename Dictionary>
+bool check_concurrent_dictionary(Dictionary& dict) {
+	constexpr int writers = 4;
+	constexpr int keys_per_writer = 10000;
+
+	std::atomic_bool writing(true);
+	std::atomic_bool ok(true);
+
+	std::vector<std::thread> threads;
+	for (int w = 0; w < writers; w++) {
+		threads.emplace_back([&dict, w]() {
+			for (int i = 0; i < keys_per_writer; i++) {
+				int key = w * keys_per_writer + i;
+				dict.set(key, key);
+				if (i % 2 == 0) {
+					dict.set(key, key * 2);
+				}
+			}
+		});
+	}
+
+	std::vector<std::thread> readers;
+	for (int r = 0; r < 2; r++) {
+		readers.emplace_back([&dict, &writing, &ok]() {
+			while (writing.load()) {
+				for (int key = 0; key < writers * keys_per_writer; key += 97) {
+					auto v = dict.get(key);
+					if (v.has_value() && v.value() != key && v.value() != key * 2) {
+						ok.store(false);
+					}
+				}
+				std::this_thread::yield();
+			}
+		});
+	}
+
+	for (auto& t : threads) {
+		t.join();
+	}
+	writing.store(false);
+	for (auto& t : readers) {
+		t.join();
+	}
+
+	if (!ok.load() || dict.size() != writers * keys_per_writer) {
+		std::cerr << "[ConcurrentDictionary] Inconsistent reads or size after concurrent inserts" << std::endl;
+		return false;
+	}
+
+	for (int key = 0; key < writers * keys_per_writer; key++) {
+		auto v = dict.get(key);
+		int expected = (key % keys_per_writer) % 2 == 0 ? key * 2 : key;
+		if (!v.has_value() || v.value() != expected) {
+			std::cerr << "[ConcurrentDictionary] Wrong value for key " << key << std::endl;
+			return false;
+		}
+	}
+
+	threads.clear();
+	for (int w = 0; w < writers; w++) {
+		threads.emplace_back([&dict, w]() {
+			for (int i = 1; i < keys_per_writer; i += 2) {
+				dict.erase(w * keys_per_writer + i);
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	size_t iterated = 0;
+	for (auto kv : dict) {
+		if (kv.second != kv.first * 2) {
+			std::cerr << "[ConcurrentDictionary] Erased key " << kv.first << " still present" << std::endl;
+			return false;
+		}
+		iterated++;
+	}
+
+	return iterated == dict.size() && iterated == writers * keys_per_writer / 2 && !dict.erase(1);
+}
+
+bool test_concurrent_dictionary() {
+	// Tiny initial table, so it is resized many times while readers are running
+	ConcurrentDictionary<int, int> dict(4, 1 << 20);
+	return check_concurrent_dictionary(dict);
+}
+
+Task<int> expensive_value(std::atomic_int& calls, bool fail) {
+	calls.fetch_add(1);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	if (fail) {
+		throw std::runtime_error("Factory failed");
+	}
+	co_return 42;
+}
+
+Task<int> gated_value(std::atomic_bool& started, std::atomic_bool& release, int value) {
+	started.store(true);
+	while (!release.load()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	co_return value;
+}
+
+Task<int, InlineScheduler> inline_value() {
+	co_return 41;
+}
+
+Task<int, InlineScheduler> nested_value(ConcurrentDictionary<int, int>& dict) {
+	auto inner = co_await dict.get_or_add_async(2, []() { return inline_value(); });
+	co_return inner + 1;
+}
+
+bool test_get_or_add_async() {
+	constexpr int callers = 200;
+
+	ConcurrentDictionary<int, int> dict;
+	std::atomic_int calls(0);
+	std::atomic_int failures(0);
+	std::atomic_int correct(0);
+
+	// Every caller fails together with the single in-flight factory
+	std::vector<Task<>> tasks;
+	for (int i = 0; i < callers; i++) {
+		tasks.push_back(([](ConcurrentDictionary<int, int>& dict, std::atomic_int& calls, std::atomic_int& failures) -> Task<> {
+			try {
+				co_await dict.get_or_add_async(1, [&calls]() { return expensive_value(calls, true); });
+			} catch (const std::runtime_error&) {
+				failures.fetch_add(1);
+			}
+		})(dict, calls, failures));
+	}
+	for (auto& t : tasks) {
+		t.wait();
+	}
+
+	if (failures.load() != callers || dict.get(1).has_value()) {
+		std::cerr << "[GetOrAddAsync] Expected every caller to fail without storing a value" << std::endl;
+		return false;
+	}
+
+	// The failure did not poison the key: the next factory runs, exactly once
+	calls.store(0);
+	tasks.clear();
+	for (int i = 0; i < callers; i++) {
+		tasks.push_back(([](ConcurrentDictionary<int, int>& dict, std::atomic_int& calls, std::atomic_int& correct) -> Task<> {
+			auto v = co_await dict.get_or_add_async(1, [&calls]() { return expensive_value(calls, false); });
+			if (v == 42) {
+				correct.fetch_add(1);
+			}
+		})(dict, calls, correct));
+	}
+	for (auto& t : tasks) {
+		t.wait();
+	}
+
+	if (calls.load() != 1 || correct.load() != callers || dict.get(1) != 42) {
+		std::cerr << "[GetOrAddAsync] Factory ran " << calls.load() << " times" << std::endl;
+		return false;
+	}
+
+	// Inline factories run right away, and may fill other keys of the same dictionary
+	auto nested = dict.get_or_add_async(3, [&dict]() { return nested_value(dict); }).wait();
+	if (nested != 42 || dict.get(2) != 41 || dict.get(3) != 42) {
+		std::cerr << "[GetOrAddAsync] Nested factory returned " << nested << std::endl;
+		return false;
+	}
+
+	// A value set while the factory runs wins over its result
+	std::atomic_bool started(false);
+	std::atomic_bool release(false);
+	auto overtaken = dict.get_or_add_async(7, [&started, &release]() { return gated_value(started, release, 1); });
+	while (!started.load()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	dict.set(7, 99);
+	release.store(true);
+	if (overtaken.wait() != 99 || dict.get(7) != 99) {
+		std::cerr << "[GetOrAddAsync] Factory result overwrote a newer value" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool test_flat_dictionary() {
+	ConcurrentFlatDictionary<int, int> dict(16);
+	if (!check_concurrent_dictionary(dict)) {
+		return false;
+	}
+
+	// Keys and values that are not stored inline
+	ConcurrentFlatDictionary<std::string, std::string> names;
+	for (int i = 0; i < 1000; i++) {
+		names.set("key" + std::to_string(i), std::to_string(i));
+	}
+	for (int i = 0; i < 1000; i += 2) {
+		names.set("key" + std::to_string(i), "even");
+		names.erase("key" + std::to_string(i + 1));
+	}
+
+	size_t iterated = 0;
+	for (auto kv : names) {
+		if (kv.second != "even") {
+			return false;
+		}
+		iterated++;
+	}
+	return iterated == 500 && names.get("key10") == "even" && !names.get("key11").has_value();
+}
+
+bool test_async_cache() {
+	// CLOCK: entries read since they were inserted survive the next sweep
+	AsyncCache<int, int> cache(100, AsyncCache<int, int>::clock::duration::zero(), nullptr, 1);
+	for (int i = 0; i < 100; i++) {
+		cache.set(i, i);
+	}
+	for (int i = 0; i < 50; i++) {
+		cache.get(i);
+	}
+	for (int i = 100; i < 150; i++) {
+		cache.set(i, i);
+	}
+	for (int i = 0; i < 150; i++) {
+		if (cache.get(i).has_value() != (i < 50 || i >= 100)) {
+			std::cerr << "[AsyncCache] Unexpected eviction of key " << i << std::endl;
+			return false;
+		}
+	}
+	if (cache.size() != 100) {
+		return false;
+	}
+
+	// Capacities that do not divide between the shards are still honored exactly
+	for (size_t capacity : {10, 20, 100}) {
+		AsyncCache<int, int> bounded(capacity);
+		for (int i = 0; i < 1000; i++) {
+			bounded.set(i, i);
+		}
+		if (bounded.size() != capacity) {
+			std::cerr << "[AsyncCache] Capacity " << capacity << " holds " << bounded.size() << " entries" << std::endl;
+			return false;
+		}
+	}
+
+	// Expired entries are dropped on lookup
+	cache.set(1000, 1, std::chrono::milliseconds(20));
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	if (cache.get(1000).has_value() || cache.size() != 99) {
+		std::cerr << "[AsyncCache] Entry outlived its time to live" << std::endl;
+		return false;
+	}
+
+	// Capacity counted in characters
+	AsyncCache<int, std::string> strings(1000, AsyncCache<int, std::string>::clock::duration::zero(), [](const int&, const std::string& s) {
+		return s.size();
+	}, 4);
+	for (int i = 0; i < 1000; i++) {
+		strings.set(i, std::string(static_cast<size_t>(i % 50 + 1), 'x'));
+		if (strings.weight() > 1000) {
+			std::cerr << "[AsyncCache] Weight " << strings.weight() << " over capacity" << std::endl;
+			return false;
+		}
+	}
+
+	// Concurrent misses share one loader
+	constexpr int callers = 100;
+	std::atomic_int calls(0);
+	std::atomic_int correct(0);
+	std::vector<Task<>> tasks;
+	for (int i = 0; i < callers; i++) {
+		tasks.push_back(([](AsyncCache<int, int>& cache, std::atomic_int& calls, std::atomic_int& correct) -> Task<> {
+			auto v = co_await cache.get_or_load(5000, [&calls](const int&) { return expensive_value(calls, false); });
+			if (v == 42) {
+				correct.fetch_add(1);
+			}
+		})(cache, calls, correct));
+	}
+	for (auto& t : tasks) {
+		t.wait();
+	}
+
+	if (calls.load() != 1 || correct.load() != callers || cache.get(5000) != 42) {
+		std::cerr << "[AsyncCache] Loader ran " << calls.load() << " times" << std::endl;
+		return false;
+	}
+
+	// Erasing a key while it loads keeps the load result out of the cache, and the next miss loads again
+	std::atomic_bool started(false);
+	std::atomic_bool release(false);
+	auto stale = cache.get_or_load(6000, [&started, &release](const int&) { return gated_value(started, release, 1); });
+	while (!started.load()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	cache.erase(6000);
+	release.store(true);
+	if (stale.wait() != 1 || cache.get(6000).has_value()) {
+		std::cerr << "[AsyncCache] Load cached after its key was erased" << std::endl;
+		return false;
+	}
+	auto fresh = cache.get_or_load(6000, [&started, &release](const int&) { return gated_value(started, release, 2); }).wait();
+	if (fresh != 2 || cache.get(6000) != 2) {
+		std::cerr << "[AsyncCache] Reload returned " << fresh << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool test_parallel_algorithms() {
+	constexpr int n = 100000;
+
+	std::vector<std::atomic_int> hits(n);
+	parallel_for(std::views::iota(0, n), 0, [&hits](int i) {
+		hits[i].fetch_add(1);
+	}).wait();
+	for (auto& h : hits) {
+		if (h.load() != 1) {
+			std::cerr << "[Parallel] parallel_for visited an element " << h.load() << " times" << std::endl;
+			return false;
+		}
+	}
+
+	std::vector<int64_t> values(n);
+	std::iota(values.begin(), values.end(), 1);
+	auto sum = ([](std::vector<int64_t>& values) -> Task<int64_t> {
+		co_return co_await parallel_reduce(values, 7, int64_t(0));
+	})(values).wait();
+	if (sum != int64_t(n) * (n + 1) / 2) {
+		std::cerr << "[Parallel] parallel_reduce returned " << sum << std::endl;
+		return false;
+	}
+
+	std::vector<int64_t> expected(n);
+	std::inclusive_scan(values.begin(), values.end(), expected.begin());
+	parallel_inclusive_scan(values, values.begin(), 1000).wait();
+	if (values != expected) {
+		std::cerr << "[Parallel] parallel_inclusive_scan mismatch" << std::endl;
+		return false;
+	}
+
+	// Values that are left empty once moved from
+	std::vector<std::string> letters;
+	for (int i = 0; i < 40; i++) {
+		letters.emplace_back(1, static_cast<char>('a' + i % 26));
+	}
+	std::vector<std::string> expected_letters(letters.size());
+	std::inclusive_scan(letters.begin(), letters.end(), expected_letters.begin());
+	parallel_inclusive_scan(letters, letters.begin(), 4).wait();
+	if (letters != expected_letters) {
+		std::cerr << "[Parallel] parallel_inclusive_scan mismatch on strings" << std::endl;
+		return false;
+	}
+
+	std::vector<int> shuffled(n);
+	for (int i = 0; i < n; i++) {
+		shuffled[i] = static_cast<int>((static_cast<uint64_t>(i) * 2654435761u) % 1000003);
+	}
+	auto sorted = shuffled;
+	std::sort(sorted.begin(), sorted.end());
+	parallel_sort(shuffled, 333).wait();
+	if (shuffled != sorted) {
+		std::cerr << "[Parallel] parallel_sort mismatch" << std::endl;
+		return false;
+	}
+
+	// The last merges are split across workers too, and non-trivial values go through the sort buffer
+	std::vector<std::string> words;
+	for (int i = 0; i < 5000; i++) {
+		words.push_back(std::to_string((static_cast<uint64_t>(i) * 2654435761u) % 100003));
+	}
+	auto sorted_words = words;
+	std::sort(sorted_words.begin(), sorted_words.end(), std::greater<>());
+	parallel_sort(words, 0, std::greater<>()).wait();
+	if (words != sorted_words) {
+		std::cerr << "[Parallel] parallel_sort mismatch on strings" << std::endl;
+		return false;
+	}
+
+	try {
+		parallel_for(std::views::iota(0, n), 100, [](int i) {
+			if (i == 5000) {
+				throw std::runtime_error("Element failed");
+			}
+		}).wait();
+		std::cerr << "[Parallel] Exception was not propagated" << std::endl;
+		return false;
+	} catch (const std::runtime_error&) {
+	}
+	return true;
+}
+
+bool test_task_graph() {
+	constexpr size_t layers = 50;
+	constexpr size_t width = 200;
+
+	// Layered graph: every node depends on two nodes of the previous layer
+	TaskGraph graph;
+	std::atomic_size_t clock(0);
+	std::vector<std::atomic_size_t> finished_at(layers * width);
+	std::vector<std::atomic_int> runs(layers * width);
+	std::vector<std::pair<size_t, size_t>> edges;
+	for (size_t i = 0; i < layers * width; i++) {
+		graph.add([i, &clock, &finished_at, &runs]() {
+			runs[i].fetch_add(1);
+			finished_at[i].store(clock.fetch_add(1) + 1);
+		});
+		if (i >= width) {
+			auto column = i % width;
+			edges.emplace_back(i - width, i);
+			edges.emplace_back(i - width - column + (column * 7 + 3) % width, i);
+		}
+	}
+	for (auto& e : edges) {
+		graph.precede(e.first, e.second);
+	}
+
+	for (int run = 1; run <= 3; run++) {
+		clock.store(0);
+		graph.run().wait();
+		for (size_t i = 0; i < runs.size(); i++) {
+			if (runs[i].load() != run) {
+				std::cerr << "[TaskGraph] Node " << i << " ran " << runs[i].load() << " times" << std::endl;
+				return false;
+			}
+		}
+		for (auto& e : edges) {
+			if (finished_at[e.first].load() >= finished_at[e.second].load()) {
+				std::cerr << "[TaskGraph] Node " << e.second << " ran before its predecessor " << e.first << std::endl;
+				return false;
+			}
+		}
+	}
+
+	// A failing node skips its successors, and the graph can still run again afterwards
+	TaskGraph failing;
+	std::atomic_bool fail(true);
+	std::atomic_int after(0);
+	auto a = failing.add([&fail]() {
+		if (fail.load()) {
+			throw std::runtime_error("Node failed");
+		}
+	});
+	auto b = failing.add([&after]() {
+		after.fetch_add(1);
+	});
+	failing.precede(a, b);
+	try {
+		failing.run().wait();
+		return false;
+	} catch (const std::runtime_error&) {
+	}
+	fail.store(false);
+	failing.run().wait();
+	if (after.load() != 1) {
+		return false;
+	}
+
+	// The graph is running as soon as run() returns
+	TaskGraph gated;
+	std::atomic_bool release(false);
+	gated.add([&release]() {
+		while (!release.load()) {
+			std::this_thread::yield();
+		}
+	});
+	auto pending = gated.run();
+	try {
+		gated.add([]() {});
+		release.store(true);
+		pending.wait();
+		std::cerr << "[TaskGraph] Modified while running" << std::endl;
+		return false;
+	} catch (const std::logic_error&) {
+	}
+	release.store(true);
+	pending.wait();
+
+	failing.precede(b, a);
+	try {
+		failing.run().wait();
+		std::cerr << "[TaskGraph] Cycle was not detected" << std::endl;
+		return false;
+	} catch (const std::logic_error&) {
+	}
+	return true;
+}
+
+Task<> fan_out(TaskGroup& group, std::atomic_int& visited, int depth) {
+	visited.fetch_add(1);
+	if (depth > 0) {
+		group.spawn(fan_out(group, visited, depth - 1));
+		group.spawn(fan_out(group, visited, depth - 1));
+	}
+	co_return;
+}
+
+Task<> failing_child(int id, AsyncManualResetEvent& gate) {
+	co_await gate.wait();
+	throw std::runtime_error("Child " + std::to_string(id) + " failed");
+}
+
+bool test_task_group() {
+	TaskGroup group;
+	std::atomic_int visited(0);
+
+	// Children spawning children, into the same group
+	([](TaskGroup& group, std::atomic_int& visited) -> Task<> {
+		group.spawn(fan_out(group, visited, 10));
+		co_await group.join();
+	})(group, visited).wait();
+	if (visited.load() != (1 << 11) - 1 || group.pending() != 0) {
+		std::cerr << "[TaskGroup] join() completed after " << visited.load() << " children" << std::endl;
+		return false;
+	}
+
+	// Every failure is reported
+	AsyncManualResetEvent gate;
+	for (int i = 0; i < 10; i++) {
+		group.spawn(failing_child(i, gate));
+	}
+	gate.set();
+	try {
+		group.join().wait();
+		return false;
+	} catch (const AggregateException& e) {
+		if (e.exceptions.size() != 10) {
+			return false;
+		}
+	}
+
+	// A failure cancels the group until it is joined
+	group.spawn(failing_child(0, gate));
+	while (!group.is_cancelled()) {
+		std::this_thread::yield();
+	}
+	if (group.spawn([&group, &visited]() { return fan_out(group, visited, 0); })) {
+		return false;
+	}
+	try {
+		group.join().wait();
+		return false;
+	} catch (const std::runtime_error&) {
+	}
+	if (group.is_cancelled() || !group.spawn([&group, &visited]() { return fan_out(group, visited, 0); })) {
+		return false;
+	}
+	group.join().wait();
+
+	// A cancelled group attaches no children, and stays cancelled once joined
+	group.cancel();
+	auto detached = fan_out(group, visited, 0);
+	if (group.spawn(detached) || group.pending() != 0) {
+		return false;
+	}
+	detached.wait();
+	group.join().wait();
+	return group.is_cancelled();
+}
+
+size_t count_occurrences(const std::string& text, const std::string& pattern) {
+	size_t count = 0;
+	for (auto pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + pattern.size())) {
+		count++;
+	}
+	return count;
+}
+
+bool test_trace() {
+	int task = 0;
+	int awaited = 0;
+	int flood = 0;
+	Trace::clear();
+
+	Trace::record(TraceEvent::Resume, &task);
+	Trace::record(TraceEvent::Await, &task, &awaited);
+	Trace::record(TraceEvent::Suspend, &task);
+
+	// Only the most recent events of a thread are kept. The thread stays alive until the events were written,
+	// or a thread pool worker could reuse its buffer
+	std::atomic_bool flooded(false);
+	std::atomic_bool written(false);
+	std::thread flooding([&flood, &flooded, &written]() {
+		for (int i = 0; i < CRLIB_TRACE_BUFFER_SIZE + 1000; i++) {
+			Trace::record(TraceEvent::Create, &flood);
+		}
+		flooded.store(true);
+		while (!written.load()) {
+			std::this_thread::yield();
+		}
+	});
+	while (!flooded.load()) {
+		std::this_thread::yield();
+	}
+
+#ifdef CRLIB_TRACING
+	([]() -> Task<> {
+		co_return;
+	})().wait();
+	inline_value().wait();
+#endif
+
+	std::stringstream ss;
+	Trace::write_chrome_json(ss);
+	auto json = ss.str();
+	written.store(true);
+	flooding.join();
+
+	std::stringstream id;
+	id << "\"task\":\"0x" << std::hex << reinterpret_cast<uintptr_t>(&task) << "\"";
+	std::stringstream awaited_id;
+	awaited_id << "\"awaiting\":\"0x" << std::hex << reinterpret_cast<uintptr_t>(&awaited) << "\"";
+	std::stringstream flood_id;
+	flood_id << "\"task\":\"0x" << std::hex << reinterpret_cast<uintptr_t>(&flood) << "\"";
+
+	if (json.rfind("{\"traceEvents\":[", 0) != 0 || count_occurrences(json, id.str()) != 3 || count_occurrences(json, awaited_id.str()) != 1) {
+		std::cerr << "[Trace] Missing events" << std::endl;
+		return false;
+	}
+	if (count_occurrences(json, flood_id.str()) != CRLIB_TRACE_BUFFER_SIZE) {
+		std::cerr << "[Trace] Ring buffer kept " << count_occurrences(json, flood_id.str()) << " events" << std::endl;
+		return false;
+	}
+#ifdef CRLIB_TRACING
+	// Including the inlined task, whose Complete must not lose its frame
+	if (count_occurrences(json, "\"name\":\"Complete\"") < 2 || count_occurrences(json, "\"s\":\"t\",\"args\":{\"task\":\"0x0\"}") != 0) {
+		std::cerr << "[Trace] Task events were not recorded" << std::endl;
+		return false;
+	}
+#endif
+
+	Trace::clear();
+	std::stringstream cleared;
+	Trace::write_chrome_json(cleared);
+	return count_occurrences(cleared.str(), flood_id.str()) == 0;
+}
+
+bool test_logger() {
+	std::vector<std::string> lines;
+	Logger::set_sink([&lines](const std::string& line) {
+		lines.push_back(line);
+	});
+	Logger::flush();
+	lines.clear();
+
+	constexpr int threads = 4;
+	constexpr int messages = 500;
+	std::vector<std::thread> writers;
+	for (int t = 0; t < threads; t++) {
+		writers.emplace_back([t]() {
+			for (int i = 0; i < messages; i++) {
+				CC_LOG("writer {} message {} ratio {} ok {} name {}", t, static_cast<unsigned>(i), 0.5, i % 2 == 0, "abc");
+			}
+		});
+	}
+	for (auto& w : writers) {
+		w.join();
+	}
+	Logger::flush();
+
+	size_t matching = 0;
+	for (auto& l : lines) {
+		if (l.find("message ") != std::string::npos && l.find(" ratio 0.5 ok ") != std::string::npos && l.ends_with(" name abc")) {
+			matching++;
+		}
+	}
+	if (matching != threads * messages || lines[0].rfind("[LOG][", 0) != 0) {
+		std::cerr << "[Logger] Got " << matching << " matching lines" << std::endl;
+		Logger::set_sink(nullptr);
+		return false;
+	}
+
+	// A full ring drops records instead of blocking
+	auto dropped = Logger::dropped();
+	for (int i = 0; i < CRLIB_LOG_BUFFER_SIZE + 10; i++) {
+		CC_LOG("flood {}", i);
+	}
+	lines.clear();
+	Logger::start(std::chrono::milliseconds(1));
+	Logger::stop();
+	CC_LOG("after {}", 1);
+	Logger::flush();
+	Logger::set_sink(nullptr);
+
+	if (Logger::dropped() - dropped != 10 || lines.size() != CRLIB_LOG_BUFFER_SIZE + 1 || !lines.back().ends_with("after 1")) {
+		std::cerr << "[Logger] Dropped " << Logger::dropped() - dropped << ", flushed " << lines.size() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+Task<int> inspector_inner(AsyncMutex* mutex) {
+	auto guard = co_await mutex->lock();
+	co_return 1;
+}
+
+Task<int> inspector_outer(AsyncMutex* mutex) {
+	auto inner = inspector_inner(mutex);
+	auto value = co_await inner;
+	co_return value + 1;
+}
+
+bool test_inspector() {
+#ifdef CRLIB_INSPECTOR
+	AsyncMutex mutex;
+	mutex.try_lock();
+	auto task = inspector_outer(&mutex);
+
+	// Both tasks end up suspended: the inner one on the mutex, the outer one on the inner one
+	std::vector<TaskSnapshot> tasks;
+	const TaskSnapshot* inner = nullptr;
+	for (int i = 0; i < 500 && (inner == nullptr || !inner->awaited_by.has_value()); i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		tasks = Inspector::snapshot();
+		inner = nullptr;
+		for (auto& t : tasks) {
+			if (t.state == TaskState::Suspended && t.awaiting == &mutex) {
+				inner = &t;
+			}
+		}
+	}
+
+	if (inner == nullptr || !inner->awaited_by.has_value()) {
+		std::cerr << "[Inspector] The tasks were not found" << std::endl;
+		return false;
+	}
+	auto& outer = tasks[inner->awaited_by.value()];
+	if (std::string(inner->location.function_name()).find("inspector_inner") == std::string::npos ||
+		std::string(outer.location.function_name()).find("inspector_outer") == std::string::npos ||
+		inner->awaiting_type.find("AsyncMutex") == std::string::npos || outer.awaiting != inner->lock) {
+		std::cerr << "[Inspector] Wrong task details" << std::endl;
+		return false;
+	}
+
+	std::stringstream ss;
+	Inspector::dump(ss);
+	std::cout << ss.str();
+	if (ss.str().find("inspector_outer") == std::string::npos) {
+		return false;
+	}
+
+	mutex.unlock();
+	if (task.wait() != 2) {
+		return false;
+	}
+
+	// The frames are destroyed right after completing their locks
+	for (int i = 0; i < 500 && Inspector::live_tasks() != 0; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return Inspector::live_tasks() == 0;
+#else
+	return Inspector::snapshot().empty();
+#endif
+}
+
+bool test_histogram() {
+	LatencyHistogram h;
+	if (h.count() != 0 || h.percentile(50) != 0) {
+		return false;
+	}
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&h, t]() {
+			for (uint64_t v = t + 1; v <= 100000; v += 4) {
+				h.record(v);
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	if (h.count() != 100000 || h.min() != 1 || h.max() != 100000 || h.mean() != 50000.5) {
+		std::cerr << "[Histogram] Wrong count, min, max or mean" << std::endl;
+		return false;
+	}
+
+	// Values are kept within 1/64 of themselves
+	auto close_to = [](uint64_t value, uint64_t expected) {
+		auto diff = value > expected ? value - expected : expected - value;
+		return diff <= expected / 64 + 1;
+	};
+	if (!close_to(h.percentile(50), 50000) || !close_to(h.percentile(99), 99000) || !close_to(h.percentile(99.9), 99900)
+		|| h.percentile(100) != 100000 || h.percentile(0) != 1 || !close_to(h.percentile(10), 10000)) {
+		std::cerr << "[Histogram] Wrong percentiles: " << h.percentile(50) << " " << h.percentile(99) << " " << h.percentile(99.9) << std::endl;
+		return false;
+	}
+
+	// Small values are exact, huge ones still have a bucket
+	LatencyHistogram other;
+	other.record(0);
+	other.record(127);
+	other.record(std::numeric_limits<uint64_t>::max());
+	if (other.percentile(0) != 0 || other.percentile(50) != 127 || other.percentile(100) != std::numeric_limits<uint64_t>::max()) {
+		std::cerr << "[Histogram] Wrong bucket bounds" << std::endl;
+		return false;
+	}
+
+	h.merge(other);
+	if (h.count() != 100003 || h.min() != 0 || h.max() != std::numeric_limits<uint64_t>::max()) {
+		return false;
+	}
+	h.reset();
+	return h.count() == 0 && h.max() == 0;
+}
+
+bool test_scheduling_delay() {
+	([]() -> Task<> {
+		co_return;
+	})().wait();
+	auto scheduler = std::dynamic_pointer_cast<ThreadPoolTaskScheduler>(BaseTaskScheduler::default_task_scheduler);
+	if (scheduler == nullptr) {
+		return false;
+	}
+	auto pool = scheduler->thread_pool;
+
+	pool->set_scheduling_delay_sampling(1);
+	pool->reset_scheduling_delay();
+	for (int i = 0; i < 1000; i++) {
+		([]() -> Task<> {
+			co_return;
+		})().wait();
+	}
+
+	LatencyHistogram delay;
+	pool->merge_scheduling_delay(delay);
+	if (delay.count() < 1000 || delay.percentile(50) == 0 || delay.percentile(50) > delay.percentile(99.9)) {
+		std::cerr << "[SchedulingDelay] Recorded " << delay.count() << " delays, p50 " << delay.percentile(50) << "ns" << std::endl;
+		return false;
+	}
+
+	pool->set_scheduling_delay_sampling(0);
+	pool->reset_scheduling_delay();
+	([]() -> Task<> {
+		co_return;
+	})().wait();
+	LatencyHistogram disabled;
+	pool->merge_scheduling_delay(disabled);
+	pool->set_scheduling_delay_sampling(CRLIB_SCHEDULING_DELAY_SAMPLING);
+	return disabled.count() == 0;
+}
+
+struct CountingObserver : public SchedulerObserver {
+	std::atomic_int submits = 0;
+	std::atomic_int resumes_begun = 0;
+	std::atomic_int resumes_ended = 0;
+	std::atomic<int64_t> cpu_time = 0;
+
+	void on_submit(std::coroutine_handle<> h) override {
+		submits++;
+	}
+
+	void on_resume_begin(std::coroutine_handle<> h) override {
+		resumes_begun++;
+	}
+
+	void on_resume_end(std::coroutine_handle<> h, std::chrono::nanoseconds cpu) override {
+		resumes_ended++;
+		cpu_time += cpu.count();
+	}
+};
+
+bool test_scheduler_observer() {
+	([]() -> Task<> {
+		co_return;
+	})().wait();
+	auto observer = std::make_shared<CountingObserver>();
+	BaseTaskScheduler::default_task_scheduler->set_observer(observer, true);
+
+	for (int i = 0; i < 100; i++) {
+		([]() -> Task<> {
+			// Burn some CPU, so that it shows up in the accounting
+			auto start = internal::thread_cpu_time();
+			while (internal::thread_cpu_time() - start < std::chrono::microseconds(100)) {
+
+			}
+			co_return;
+		})().wait();
+	}
+	BaseTaskScheduler::default_task_scheduler->set_observer(nullptr);
+
+	// Workers may still be finishing the last resume
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+#ifdef CRLIB_OBSERVERS
+	if (observer->submits < 100 || observer->resumes_begun < 100 || observer->resumes_begun != observer->resumes_ended
+		|| observer->cpu_time < std::chrono::nanoseconds(std::chrono::milliseconds(10)).count()) {
+		std::cerr << "[SchedulerObserver] " << observer->submits << " submits, " << observer->resumes_begun << "/" << observer->resumes_ended
+			<< " resumes, " << observer->cpu_time << "ns CPU" << std::endl;
+		return false;
+	}
+
+	// Replaced observers are released once no thread can still be calling them
+	std::weak_ptr<SchedulerObserver> replaced = observer;
+	observer.reset();
+	for (int i = 0; i < 1000 && !replaced.expired(); i++) {
+		Epoch::collect();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return replaced.expired();
+#else
+	return observer->submits == 0 && observer->resumes_begun == 0;
+#endif
+}
+
+Task<bool> home_child(int delay_ms) {
+	std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+	co_return true;
+}
+
+Task<bool> home_parent(Task<bool> child, BaseTaskScheduler* home) {
+	if (BaseTaskScheduler::Current() != home) {
+		co_return false;
+	}
+	auto ok = co_await child;
+	co_return ok && BaseTaskScheduler::Current() == home;
+}
+
+Task<int> home_chain(int depth) {
+	if (depth == 0) {
+		co_return 0;
+	}
+	auto inner = co_await home_chain(depth - 1);
+	co_return inner + 1;
+}
+
+bool test_resume_on_home() {
+	auto a = std::make_shared<ThreadPoolTaskScheduler>(2);
+	auto b = std::make_shared<ThreadPoolTaskScheduler>(2);
+
+	// Tasks start on the scheduler of the thread creating them
+	BaseTaskScheduler::SetCurrent(a.get());
+	auto child = home_child(20);
+	BaseTaskScheduler::SetCurrent(b.get());
+	auto parent = home_parent(child, b.get());
+	BaseTaskScheduler::SetCurrent(nullptr);
+	if (!parent.wait()) {
+		std::cerr << "[ResumeOnHome] Awaiter resumed on the scheduler of the awaited task" << std::endl;
+		return false;
+	}
+
+	// Completions resume their awaiters inline on the same scheduler, up to a maximum depth
+	constexpr int depth = 5000;
+	auto chain = home_chain(depth).wait();
+	if (chain != depth) {
+		std::cerr << "[ResumeOnHome] Chain returned " << chain << std::endl;
+		return false;
+	}
+	return true;
+}
+
+Task<int> state_source(int delay_ms) {
+	std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+	co_return 42;
+}
+
+Task<int> state_thrower() {
+	throw std::runtime_error("state_thrower");
+	co_return 0;
+}
+
+Task<bool> state_awaiter(Task<int> source) {
+	auto v = co_await source;
+	co_return v == 42;
+}
+
+bool test_task_state() {
+	// Coroutines, threads blocking in wait() and callbacks all wait on the same completion
+	auto source = state_source(50);
+	std::vector<Task<bool>> awaiters;
+	for (int i = 0; i < 32; i++) {
+		awaiters.push_back(state_awaiter(source));
+	}
+	std::atomic_int callbacks(0);
+	for (int i = 0; i < 8; i++) {
+		source.lock->append_coroutine([&callbacks]() {
+			callbacks.fetch_add(1);
+		});
+	}
+	std::atomic_int blocked_ok(0);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < 4; i++) {
+		threads.emplace_back([&source, &blocked_ok]() {
+			if (source.wait() == 42) {
+				blocked_ok.fetch_add(1);
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+	for (auto& a : awaiters) {
+		if (!a.wait()) {
+			std::cerr << "[TaskState] Awaiter saw the wrong result" << std::endl;
+			return false;
+		}
+	}
+	if (blocked_ok.load() != 4 || callbacks.load() != 8) {
+		std::cerr << "[TaskState] " << blocked_ok.load() << " blocked waits, " << callbacks.load() << " callbacks" << std::endl;
+		return false;
+	}
+
+	// Once completed, waiters run right away
+	bool late = false;
+	source.lock->append_coroutine([&late]() {
+		late = true;
+	});
+	if (!late || !state_awaiter(source).wait()) {
+		std::cerr << "[TaskState] Late waiter did not run" << std::endl;
+		return false;
+	}
+
+	auto failing = state_thrower();
+	try {
+		failing.wait();
+		std::cerr << "[TaskState] wait() did not rethrow" << std::endl;
+		return false;
+	} catch (const std::runtime_error&) {
+
+	}
+	return true;
+}
+
+bool test_phase_sync() {
+	constexpr int workers = 8;
+	constexpr int phases = 100;
+
+	AsyncLatch latch(workers);
+	AsyncBarrier barrier(workers);
+	WaitGroup group;
+	std::vector<std::atomic_int> phase_arrivals(phases);
+	std::atomic_int completions(0);
+	std::atomic_bool ok(true);
+
+	group.add(workers);
+	for (int i = 0; i < workers; i++) {
+		([](AsyncLatch& latch, AsyncBarrier& barrier, WaitGroup& group, std::vector<std::atomic_int>& arrivals, std::atomic_int& completions, std::atomic_bool& ok) -> Task<> {
+			latch.count_down();
+			co_await latch.wait();
+
+			for (int phase = 0; phase < phases; phase++) {
+				arrivals[phase].fetch_add(1);
+				if (co_await barrier.arrive_and_wait()) {
+					completions.fetch_add(1);
+				}
+				if (arrivals[phase].load() != workers) {
+					ok.store(false);
+				}
+			}
+			group.done();
+		})(latch, barrier, group, phase_arrivals, completions, ok);
+	}
+
+	([](WaitGroup& group) -> Task<> {
+		co_await group.wait();
+	})(group).wait();
+
+	if (!ok.load() || completions.load() != phases) {
+		std::cerr << "[PhaseSync] Barrier released a phase too early" << std::endl;
+		return false;
+	}
+
+	std::atomic_int finished(0);
+	group.add(16);
+	for (int i = 0; i < 16; i++) {
+		([](WaitGroup& group, std::atomic_int& finished) -> Task<> {
+			finished.fetch_add(1);
+			group.done();
+			co_return;
+		})(group, finished);
+	}
+
+	([](WaitGroup& group) -> Task<> {
+		co_await group.wait();
+	})(group).wait();
+
+	return finished.load() == 16 && latch.try_wait();
+}
+
+Generator<int> Fibonacci_generator(int amount) {
+	int a = 0, b = 1;
+	for (int i = 0; i < amount; i++) {
+		co_yield a;
+		int next = a + b;
+		a = b;
+		b = next;
+	}
+}
+
+Generator<int> Throwing_generator() {
+	co_yield 1;
+	throw std::runtime_error("Generator failure");
+}
+
+bool test_generator() {
+	std::vector<int> expected {0, 1, 1, 2, 3, 5, 8, 13, 21, 34};
+	std::vector<int> received;
+	for (auto v : Fibonacci_generator(10)) {
+		received.push_back(v);
+	}
+
+	if (received != expected) {
+		std::cerr << "[Generator] Unexpected sequence" << std::endl;
+		return false;
+	}
+
+	int yielded = 0;
+	try {
+		for (auto v : Throwing_generator()) {
+			yielded += v;
+		}
+	} catch (const std::runtime_error&) {
+		return yielded == 1;
+	}
+
+	std::cerr << "[Generator] Exception was not propagated" << std::endl;
+	return false;
+}
+
+// Returning from main must not wait for the workers of the default scheduler, even when one of them is blocked
+bool test_exit_while_busy() {
+	static std::atomic_bool never(false);
+	([]() -> Task<> {
+		while (!never.load()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		co_return;
+	})();
+	return true;
+}
+
 int main(int argc, char** argv) {
 	auto t = []() -> crlib::Task<> {
 		std::this_thread::sleep_for(std::chrono::seconds(3));
@@ -116,6 +1567,144 @@ int main(int argc, char** argv) {
 		return res;
 	}
 
+	if (argc > 1 && std::string(argv[1]) == "--test-async-mutex-lock") {
+		res = test_async_mutex_lock() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-async-shared-mutex") {
+		res = test_async_shared_mutex() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-async-semaphore") {
+		res = test_async_semaphore() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-async-condition-variable") {
+		res = test_async_condition_variable() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-concurrent-dictionary") {
+		res = test_concurrent_dictionary() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-get-or-add-async") {
+		res = test_get_or_add_async() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-flat-dictionary") {
+		res = test_flat_dictionary() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--test-async-cache") {
+		res = test_async_cache() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--test-parallel") {
+		res = test_parallel_algorithms() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--test-task-graph") {
+		res = test_task_graph() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--test-task-group") {
+		res = test_task_group() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--test-trace") {
+		res = test_trace() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--test-logger") {
+		res = test_logger() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-inspector") {
+		res = test_inspector() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-histogram") {
+		res = test_histogram() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-scheduling-delay") {
+		res = test_scheduling_delay() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-scheduler-observer") {
+		res = test_scheduler_observer() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-resume-on-home") {
+		res = test_resume_on_home() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-task-state") {
+		res = test_task_state() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-phase-sync") {
+		res = test_phase_sync() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-exit-while-busy") {
+		res = test_exit_while_busy() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-await-lifetime") {
+		res = test_await_lifetime() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-generator-adapters") {
+		res = test_generator_adapters() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--test-generator") {
+		res = test_generator() ? 0 : 1;
+		CC_LOGDUMP();
+		return res;
+	}
+
 	res = test_yield() ? 0 : 1;
 	CC_LOGDUMP();
 	return res;
@@ -6,6 +6,7 @@
 #include <string>
 #include <set>
 #include <mutex>
+#include <atomic>
 
 #define writers_amount 10
 
@@ -79,7 +80,60 @@ bool test_boundless() {
 	return !anyError;
 }
 
+bool test_pull_releases() {
+	crlib::BoundlessQueue<std::shared_ptr<int>> q;
+	auto value = std::make_shared<int>(1);
+	q.push(value);
+	q.pull();
+
+	// The dequeued node stays in the queue as its dummy, it must not keep the value alive
+	if (value.use_count() != 1) {
+		std::cout << "[QueueTest] Pulled value still referenced by the queue" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool test_single_producer() {
+	std::cout << "[QueueTest] Running single producer test" << std::endl;
+
+	// Pulled concurrently with the pushes, like a worker's local queue being stolen from
+	crlib::BoundlessQueue<int> q;
+	std::atomic_bool done(false);
+	std::vector<std::atomic_int> pulled(100000);
+	std::vector<std::thread> readers;
+	for (int i = 0; i < 4; i++) {
+		readers.emplace_back([&q, &done, &pulled]() {
+			while (true) {
+				auto finished = done.load();
+				auto val = q.pull();
+				if (val.has_value()) {
+					pulled[val.value()]++;
+				} else if (finished) {
+					return;
+				}
+			}
+		});
+	}
+
+	for (int i = 0; i < 100000; i++) {
+		q.push_single_producer(i);
+	}
+	done.store(true);
+	for (auto& t : readers) {
+		t.join();
+	}
+
+	for (size_t i = 0; i < pulled.size(); i++) {
+		if (pulled[i].load() != 1) {
+			std::cout << "[QueueTest] Value " << i << " pulled " << pulled[i].load() << " times" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
 int main(int argc, char** argv) {
 	//return test_generic() ? 0 : 1;
-	return test_boundless() ? 0 : 1;
+	return test_boundless() && test_pull_releases() && test_single_producer() ? 0 : 1;
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include <crlib/cc_task.h>
+#include <crlib/cc_sync_utils.h>
 #include <chrono>
+#include <atomic>
+#include <vector>
 
 struct MyCustomScheduler;
 
@@ -38,14 +41,111 @@ struct MyCustomScheduler {
 
 std::shared_ptr<MyCustomScheduler> MyCustomScheduler::da_scheduler;
 
+crlib::Task<void, crlib::EventLoopScheduler> loop_child(std::thread::id loop_thread, int* counter) {
+	if (std::this_thread::get_id() == loop_thread) {
+		// Only the loop's thread touches the counter
+		(*counter)++;
+	}
+	co_return;
+}
+
+crlib::Task<int, crlib::EventLoopScheduler> loop_main(std::thread::id loop_thread, crlib::AsyncManualResetEvent* event, int* counter) {
+	for (int i = 0; i < 1000; i++) {
+		co_await loop_child(loop_thread, counter);
+	}
+
+	// Set by another thread, while the loop sleeps
+	co_await event->wait();
+	if (std::this_thread::get_id() != loop_thread) {
+		co_return -1;
+	}
+	co_return *counter;
+}
+
+bool test_event_loop() {
+	crlib::EventLoopScheduler loop;
+	crlib::AsyncManualResetEvent event;
+	int counter = 0;
+
+	std::thread setter([&event]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		event.set();
+	});
+	auto result = loop.run_until(loop_main(std::this_thread::get_id(), &event, &counter));
+	setter.join();
+
+	if (result != 1000) {
+		std::cerr << "[EventLoop] Loop task returned " << result << std::endl;
+		return false;
+	}
+	return true;
+}
+
+crlib::Task<> pool_work() {
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	co_return;
+}
+
+crlib::Task<bool, crlib::InlineScheduler> inline_task(std::thread::id caller) {
+	if (std::this_thread::get_id() != caller) {
+		co_return false;
+	}
+
+	co_await pool_work();
+	// Resumed by the pool thread completing pool_work()
+	co_return std::this_thread::get_id() != caller;
+}
+
+bool test_inline_scheduler() {
+	auto id = std::this_thread::get_id();
+	auto t = inline_task(id);
+	if (!t.wait()) {
+		std::cerr << "[InlineScheduler] Task did not run where expected" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool test_default_init() {
+	// Threads racing to schedule the first coroutines must all create and get the same default scheduler
+	std::atomic_bool go(false);
+	std::vector<crlib::BaseTaskScheduler*> seen(8, nullptr);
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < seen.size(); i++) {
+		threads.emplace_back([&go, &seen, i]() {
+			while (!go.load()) {
+
+			}
+			seen[i] = crlib::BaseTaskScheduler::Default();
+		});
+	}
+	go.store(true);
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	for (auto s : seen) {
+		if (s == nullptr || s != crlib::BaseTaskScheduler::default_task_scheduler.get()) {
+			std::cerr << "[DefaultInit] Got scheduler " << s << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
 int main(int argc, char** argv) {
+	if (!test_default_init()) {
+		return 1;
+	}
+
 	auto s = std::make_shared<MyCustomScheduler>();
 	MyCustomScheduler::da_scheduler = s;
 
 	bool ok = true;
 	auto id = std::this_thread::get_id();
 
-	([&ok, &id]() -> crlib::Task<void, MyCustomScheduler> {
+	// The coroutine reads its captures from the lambda, which must outlive it
+	auto main_task = [&ok, &id]() -> crlib::Task<void, MyCustomScheduler> {
 		auto task_id = std::this_thread::get_id();
 
 		if (task_id != id) {
@@ -76,9 +176,13 @@ int main(int argc, char** argv) {
 		MyCustomScheduler::da_scheduler->alive = false;
 
 		co_return;
-	})();
+	};
+	main_task();
 
 	s->run();
 
+	ok = test_inline_scheduler() && ok;
+	ok = test_event_loop() && ok;
+
 	return ok ? 0 : 1;
 }
\ No newline at end of file
@@ -1,9 +1,14 @@
 #define PICOBENCH_IMPLEMENT_WITH_MAIN
 #include <picobench/picobench.hpp>
 #include <crlib/cc_task.h>
+#include <crlib/cc_sync_utils.h>
+#include <crlib/cc_task_group.h>
 #include <thread>
 #include <queue>
 #include <mutex>
+#include <map>
+#include <future>
+#include <semaphore>
 #include <condition_variable>
 
 static void queue_fill_atomic(picobench::state& s, int n_threads) {
@@ -110,4 +115,485 @@ QUEUE_FILL_ATOMIC(16);
 
 PICOBENCH_SUITE("Fill: 32 Threads");
 QUEUE_FILL_SYNC(32).baseline();
-QUEUE_FILL_ATOMIC(32);
\ No newline at end of file
+QUEUE_FILL_ATOMIC(32);
+
+/*
+ * Scheduler benchmarks. Every suite runs the default ThreadPoolTaskScheduler with 1 to 32 threads,
+ * against a baseline doing the same work with plain std::thread or std::async.
+ */
+
+static void use_thread_pool(size_t n_threads) {
+	// Pools are kept alive, so that building and stopping them is not measured
+	static std::map<size_t, std::shared_ptr<crlib::BaseTaskScheduler>> schedulers;
+	auto& scheduler = schedulers[n_threads];
+	if (scheduler == nullptr) {
+		scheduler = std::make_shared<crlib::ThreadPoolTaskScheduler>(n_threads);
+	}
+	crlib::BaseTaskScheduler::default_task_scheduler = scheduler;
+}
+
+static crlib::Task<int> bench_child(int i) {
+	co_return i;
+}
+
+static crlib::Task<> bench_empty() {
+	co_return;
+}
+
+static crlib::Task<> spawn_await_driver(int n) {
+	for (int i = 0; i < n; i++) {
+		auto child = bench_child(i);
+		co_await child;
+	}
+}
+
+static void spawn_await_task(picobench::state& s, int n_threads) {
+	use_thread_pool(n_threads);
+	s.start_timer();
+	spawn_await_driver(s.iterations()).wait();
+	s.stop_timer();
+}
+
+static void spawn_await_async(picobench::state& s, int) {
+	int sum = 0;
+	s.start_timer();
+	for (int i = 0; i < s.iterations(); i++) {
+		sum += std::async(std::launch::async, [i]() { return i; }).get();
+	}
+	s.stop_timer();
+	s.set_result(sum);
+}
+
+struct PingPongState {
+	crlib::AsyncMutex mutex;
+	crlib::AsyncConditionVariable cv;
+	int turn = 0;
+};
+
+static crlib::Task<> ping_pong_player(PingPongState* state, int me, int n) {
+	for (int i = 0; i < n; i++) {
+		auto guard = co_await state->mutex.lock();
+		auto turn = state->cv.wait(guard, [state, me]() { return state->turn == me; });
+		co_await turn;
+		state->turn = 1 - me;
+		state->cv.notify_one();
+	}
+}
+
+static void ping_pong_task(picobench::state& s, int n_threads) {
+	use_thread_pool(n_threads);
+	PingPongState state;
+	s.start_timer();
+	auto ping = ping_pong_player(&state, 0, s.iterations());
+	auto pong = ping_pong_player(&state, 1, s.iterations());
+	ping.wait();
+	pong.wait();
+	s.stop_timer();
+}
+
+static void ping_pong_thread(picobench::state& s, int) {
+	std::mutex mutex;
+	std::condition_variable cv;
+	int turn = 0;
+	int n = s.iterations();
+
+	auto player = [&mutex, &cv, &turn, n](int me) {
+		for (int i = 0; i < n; i++) {
+			std::unique_lock lock(mutex);
+			cv.wait(lock, [&turn, me]() { return turn == me; });
+			turn = 1 - me;
+			cv.notify_one();
+		}
+	};
+
+	s.start_timer();
+	std::thread pong(player, 1);
+	player(0);
+	pong.join();
+	s.stop_timer();
+}
+
+static crlib::Task<> fan_out_driver(int n) {
+	crlib::TaskGroup group;
+	for (int i = 0; i < n; i++) {
+		group.spawn(bench_child(i));
+	}
+	auto join = group.join();
+	co_await join;
+}
+
+static void fan_out_task(picobench::state& s, int n_threads) {
+	use_thread_pool(n_threads);
+	s.start_timer();
+	fan_out_driver(s.iterations()).wait();
+	s.stop_timer();
+}
+
+static void fan_out_thread(picobench::state& s, int n_threads) {
+	std::atomic_int next(0);
+	std::atomic<int64_t> sum(0);
+	int n = s.iterations();
+	std::vector<std::thread> threads;
+
+	s.start_timer();
+	for (int t = 0; t < n_threads; t++) {
+		threads.emplace_back([&next, &sum, n]() {
+			int64_t local = 0;
+			for (int i = next.fetch_add(1); i < n; i = next.fetch_add(1)) {
+				local += i;
+			}
+			sum.fetch_add(local);
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+	s.stop_timer();
+	s.set_result(static_cast<uintptr_t>(sum.load()));
+}
+
+static crlib::Task<int> bench_chain(int depth) {
+	if (depth == 0) {
+		co_return 0;
+	}
+	auto next = bench_chain(depth - 1);
+	auto value = co_await next;
+	co_return value + 1;
+}
+
+static int async_chain(int depth) {
+	if (depth == 0) {
+		return 0;
+	}
+	return std::async(std::launch::deferred, async_chain, depth - 1).get() + 1;
+}
+
+static void await_chain_task(picobench::state& s, int n_threads) {
+	use_thread_pool(n_threads);
+	s.start_timer();
+	auto depth = bench_chain(s.iterations()).wait();
+	s.stop_timer();
+	s.set_result(depth);
+}
+
+static void await_chain_async(picobench::state& s, int) {
+	s.start_timer();
+	auto depth = async_chain(s.iterations());
+	s.stop_timer();
+	s.set_result(depth);
+}
+
+static crlib::GeneratorTask<int> bench_generator(int n) {
+	for (int i = 0; i < n; i++) {
+		co_yield i;
+	}
+}
+
+static crlib::Task<int64_t> generator_consumer(int n) {
+	auto gen = bench_generator(n);
+	int64_t sum = 0;
+	while (true) {
+		auto value = co_await gen;
+		if (!value.has_value()) {
+			break;
+		}
+		sum += value.value();
+	}
+	co_return sum;
+}
+
+static void generator_task(picobench::state& s, int n_threads) {
+	use_thread_pool(n_threads);
+	s.start_timer();
+	auto sum = generator_consumer(s.iterations()).wait();
+	s.stop_timer();
+	s.set_result(static_cast<uintptr_t>(sum));
+}
+
+static void generator_thread(picobench::state& s, int) {
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::queue<int> items;
+	int n = s.iterations();
+
+	s.start_timer();
+	std::thread producer([&mutex, &cv, &items, n]() {
+		for (int i = 0; i < n; i++) {
+			std::lock_guard lock(mutex);
+			items.push(i);
+			cv.notify_one();
+		}
+	});
+
+	int64_t sum = 0;
+	for (int i = 0; i < n; i++) {
+		std::unique_lock lock(mutex);
+		cv.wait(lock, [&items]() { return !items.empty(); });
+		sum += items.front();
+		items.pop();
+	}
+	producer.join();
+	s.stop_timer();
+	s.set_result(static_cast<uintptr_t>(sum));
+}
+
+static crlib::Task<> mutex_worker(crlib::AsyncMutex* mutex, int64_t* counter, int n) {
+	for (int i = 0; i < n; i++) {
+		auto guard = co_await mutex->lock();
+		(*counter)++;
+	}
+}
+
+static void mutex_contention_task(picobench::state& s, int n_threads) {
+	use_thread_pool(n_threads);
+	crlib::AsyncMutex mutex;
+	int64_t counter = 0;
+	std::vector<crlib::Task<>> workers;
+
+	s.start_timer();
+	for (int t = 0; t < n_threads; t++) {
+		workers.push_back(mutex_worker(&mutex, &counter, s.iterations() / n_threads));
+	}
+	for (auto& w : workers) {
+		w.wait();
+	}
+	s.stop_timer();
+	s.set_result(static_cast<uintptr_t>(counter));
+}
+
+static void mutex_contention_thread(picobench::state& s, int n_threads) {
+	std::mutex mutex;
+	int64_t counter = 0;
+	int n = s.iterations() / n_threads;
+	std::vector<std::thread> threads;
+
+	s.start_timer();
+	for (int t = 0; t < n_threads; t++) {
+		threads.emplace_back([&mutex, &counter, n]() {
+			for (int i = 0; i < n; i++) {
+				std::lock_guard lock(mutex);
+				counter++;
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+	s.stop_timer();
+	s.set_result(static_cast<uintptr_t>(counter));
+}
+
+static crlib::Task<> when_all_driver(int n) {
+	for (int i = 0; i < n; i++) {
+		auto a = bench_empty();
+		auto b = bench_empty();
+		auto c = bench_empty();
+		auto d = bench_empty();
+		co_await crlib::WhenAll(a, b, c, d);
+	}
+}
+
+static void when_all_task(picobench::state& s, int n_threads) {
+	use_thread_pool(n_threads);
+	s.start_timer();
+	when_all_driver(s.iterations()).wait();
+	s.stop_timer();
+}
+
+static void when_all_async(picobench::state& s, int) {
+	s.start_timer();
+	for (int i = 0; i < s.iterations(); i++) {
+		auto a = std::async(std::launch::async, []() {});
+		auto b = std::async(std::launch::async, []() {});
+		auto c = std::async(std::launch::async, []() {});
+		auto d = std::async(std::launch::async, []() {});
+		a.get();
+		b.get();
+		c.get();
+		d.get();
+	}
+	s.stop_timer();
+}
+
+static const std::vector<int> spawn_await_iterations = {1000, 10000, 100000};
+static const std::vector<int> ping_pong_iterations = {1000, 10000, 100000};
+static const std::vector<int> fan_out_iterations = {1000, 10000, 100000, 1000000};
+// The std::async baseline recurses on the stack
+static const std::vector<int> await_chain_iterations = {100, 1000, 5000};
+static const std::vector<int> generator_iterations = {1000, 10000, 100000};
+static const std::vector<int> mutex_contention_iterations = {10000, 100000, 1000000};
+static const std::vector<int> when_all_iterations = {1000, 10000};
+
+#define SCHEDULER_BENCH(suite, kind, t) \
+void suite##_##kind##_##t (picobench::state& s) { \
+	suite##_##kind(s, t);\
+} \
+PICOBENCH(suite##_##kind##_##t).iterations(suite##_iterations).samples(SAMPLES)
+
+PICOBENCH_SUITE("Spawn+await: 1 Thread");
+SCHEDULER_BENCH(spawn_await, async, 1).baseline();
+SCHEDULER_BENCH(spawn_await, task, 1);
+
+PICOBENCH_SUITE("Spawn+await: 2 Threads");
+SCHEDULER_BENCH(spawn_await, async, 2).baseline();
+SCHEDULER_BENCH(spawn_await, task, 2);
+
+PICOBENCH_SUITE("Spawn+await: 4 Threads");
+SCHEDULER_BENCH(spawn_await, async, 4).baseline();
+SCHEDULER_BENCH(spawn_await, task, 4);
+
+PICOBENCH_SUITE("Spawn+await: 8 Threads");
+SCHEDULER_BENCH(spawn_await, async, 8).baseline();
+SCHEDULER_BENCH(spawn_await, task, 8);
+
+PICOBENCH_SUITE("Spawn+await: 16 Threads");
+SCHEDULER_BENCH(spawn_await, async, 16).baseline();
+SCHEDULER_BENCH(spawn_await, task, 16);
+
+PICOBENCH_SUITE("Spawn+await: 32 Threads");
+SCHEDULER_BENCH(spawn_await, async, 32).baseline();
+SCHEDULER_BENCH(spawn_await, task, 32);
+
+PICOBENCH_SUITE("Ping-pong: 1 Thread");
+SCHEDULER_BENCH(ping_pong, thread, 1).baseline();
+SCHEDULER_BENCH(ping_pong, task, 1);
+
+PICOBENCH_SUITE("Ping-pong: 2 Threads");
+SCHEDULER_BENCH(ping_pong, thread, 2).baseline();
+SCHEDULER_BENCH(ping_pong, task, 2);
+
+PICOBENCH_SUITE("Ping-pong: 4 Threads");
+SCHEDULER_BENCH(ping_pong, thread, 4).baseline();
+SCHEDULER_BENCH(ping_pong, task, 4);
+
+PICOBENCH_SUITE("Ping-pong: 8 Threads");
+SCHEDULER_BENCH(ping_pong, thread, 8).baseline();
+SCHEDULER_BENCH(ping_pong, task, 8);
+
+PICOBENCH_SUITE("Ping-pong: 16 Threads");
+SCHEDULER_BENCH(ping_pong, thread, 16).baseline();
+SCHEDULER_BENCH(ping_pong, task, 16);
+
+PICOBENCH_SUITE("Ping-pong: 32 Threads");
+SCHEDULER_BENCH(ping_pong, thread, 32).baseline();
+SCHEDULER_BENCH(ping_pong, task, 32);
+
+PICOBENCH_SUITE("Fan-out: 1 Thread");
+SCHEDULER_BENCH(fan_out, thread, 1).baseline();
+SCHEDULER_BENCH(fan_out, task, 1);
+
+PICOBENCH_SUITE("Fan-out: 2 Threads");
+SCHEDULER_BENCH(fan_out, thread, 2).baseline();
+SCHEDULER_BENCH(fan_out, task, 2);
+
+PICOBENCH_SUITE("Fan-out: 4 Threads");
+SCHEDULER_BENCH(fan_out, thread, 4).baseline();
+SCHEDULER_BENCH(fan_out, task, 4);
+
+PICOBENCH_SUITE("Fan-out: 8 Threads");
+SCHEDULER_BENCH(fan_out, thread, 8).baseline();
+SCHEDULER_BENCH(fan_out, task, 8);
+
+PICOBENCH_SUITE("Fan-out: 16 Threads");
+SCHEDULER_BENCH(fan_out, thread, 16).baseline();
+SCHEDULER_BENCH(fan_out, task, 16);
+
+PICOBENCH_SUITE("Fan-out: 32 Threads");
+SCHEDULER_BENCH(fan_out, thread, 32).baseline();
+SCHEDULER_BENCH(fan_out, task, 32);
+
+PICOBENCH_SUITE("Await chain: 1 Thread");
+SCHEDULER_BENCH(await_chain, async, 1).baseline();
+SCHEDULER_BENCH(await_chain, task, 1);
+
+PICOBENCH_SUITE("Await chain: 2 Threads");
+SCHEDULER_BENCH(await_chain, async, 2).baseline();
+SCHEDULER_BENCH(await_chain, task, 2);
+
+PICOBENCH_SUITE("Await chain: 4 Threads");
+SCHEDULER_BENCH(await_chain, async, 4).baseline();
+SCHEDULER_BENCH(await_chain, task, 4);
+
+PICOBENCH_SUITE("Await chain: 8 Threads");
+SCHEDULER_BENCH(await_chain, async, 8).baseline();
+SCHEDULER_BENCH(await_chain, task, 8);
+
+PICOBENCH_SUITE("Await chain: 16 Threads");
+SCHEDULER_BENCH(await_chain, async, 16).baseline();
+SCHEDULER_BENCH(await_chain, task, 16);
+
+PICOBENCH_SUITE("Await chain: 32 Threads");
+SCHEDULER_BENCH(await_chain, async, 32).baseline();
+SCHEDULER_BENCH(await_chain, task, 32);
+
+PICOBENCH_SUITE("Generator: 1 Thread");
+SCHEDULER_BENCH(generator, thread, 1).baseline();
+SCHEDULER_BENCH(generator, task, 1);
+
+PICOBENCH_SUITE("Generator: 2 Threads");
+SCHEDULER_BENCH(generator, thread, 2).baseline();
+SCHEDULER_BENCH(generator, task, 2);
+
+PICOBENCH_SUITE("Generator: 4 Threads");
+SCHEDULER_BENCH(generator, thread, 4).baseline();
+SCHEDULER_BENCH(generator, task, 4);
+
+PICOBENCH_SUITE("Generator: 8 Threads");
+SCHEDULER_BENCH(generator, thread, 8).baseline();
+SCHEDULER_BENCH(generator, task, 8);
+
+PICOBENCH_SUITE("Generator: 16 Threads");
+SCHEDULER_BENCH(generator, thread, 16).baseline();
+SCHEDULER_BENCH(generator, task, 16);
+
+PICOBENCH_SUITE("Generator: 32 Threads");
+SCHEDULER_BENCH(generator, thread, 32).baseline();
+SCHEDULER_BENCH(generator, task, 32);
+
+PICOBENCH_SUITE("AsyncMutex contention: 1 Thread");
+SCHEDULER_BENCH(mutex_contention, thread, 1).baseline();
+SCHEDULER_BENCH(mutex_contention, task, 1);
+
+PICOBENCH_SUITE("AsyncMutex contention: 2 Threads");
+SCHEDULER_BENCH(mutex_contention, thread, 2).baseline();
+SCHEDULER_BENCH(mutex_contention, task, 2);
+
+PICOBENCH_SUITE("AsyncMutex contention: 4 Threads");
+SCHEDULER_BENCH(mutex_contention, thread, 4).baseline();
+SCHEDULER_BENCH(mutex_contention, task, 4);
+
+PICOBENCH_SUITE("AsyncMutex contention: 8 Threads");
+SCHEDULER_BENCH(mutex_contention, thread, 8).baseline();
+SCHEDULER_BENCH(mutex_contention, task, 8);
+
+PICOBENCH_SUITE("AsyncMutex contention: 16 Threads");
+SCHEDULER_BENCH(mutex_contention, thread, 16).baseline();
+SCHEDULER_BENCH(mutex_contention, task, 16);
+
+PICOBENCH_SUITE("AsyncMutex contention: 32 Threads");
+SCHEDULER_BENCH(mutex_contention, thread, 32).baseline();
+SCHEDULER_BENCH(mutex_contention, task, 32);
+
+PICOBENCH_SUITE("WhenAll: 1 Thread");
+SCHEDULER_BENCH(when_all, async, 1).baseline();
+SCHEDULER_BENCH(when_all, task, 1);
+
+PICOBENCH_SUITE("WhenAll: 2 Threads");
+SCHEDULER_BENCH(when_all, async, 2).baseline();
+SCHEDULER_BENCH(when_all, task, 2);
+
+PICOBENCH_SUITE("WhenAll: 4 Threads");
+SCHEDULER_BENCH(when_all, async, 4).baseline();
+SCHEDULER_BENCH(when_all, task, 4);
+
+PICOBENCH_SUITE("WhenAll: 8 Threads");
+SCHEDULER_BENCH(when_all, async, 8).baseline();
+SCHEDULER_BENCH(when_all, task, 8);
+
+PICOBENCH_SUITE("WhenAll: 16 Threads");
+SCHEDULER_BENCH(when_all, async, 16).baseline();
+SCHEDULER_BENCH(when_all, task, 16);
+
+PICOBENCH_SUITE("WhenAll: 32 Threads");
+SCHEDULER_BENCH(when_all, async, 32).baseline();
+SCHEDULER_BENCH(when_all, task, 32);
@@ -0,0 +1,215 @@
+#include <crlib/cc_base_queue.h>
+#include <crlib/cc_boundless_queue.h>
+#include <crlib/cc_synchronous_queue.h>
+#include <crlib/cc_histogram.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Full-duplex queue benchmark: producers and consumers run at the same time, with several producer:consumer ratios,
+ * either pushing steadily or in bursts. Every push and pull is timed, and every item carries its push time, so the
+ * time it spent in the queue is measured too. Run with --json <path> to also write the results as JSON.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static uint64_t now_ns() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+}
+
+struct Scenario {
+	int producers;
+	int consumers;
+	// Items pushed before each pause, 0 to push steadily
+	int burst;
+};
+
+struct Summary {
+	uint64_t count;
+	uint64_t min;
+	double mean;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t max;
+
+	explicit Summary(const crlib::LatencyHistogram& h) : count(h.count()), min(h.min()), mean(h.mean()), p50(h.percentile(50)),
+		p90(h.percentile(90)), p99(h.percentile(99)), p999(h.percentile(99.9)), max(h.max()) {
+
+	}
+};
+
+struct Result {
+	std::string queue;
+	Scenario scenario;
+	uint64_t items;
+	double seconds;
+	uint64_t empty_pulls;
+	Summary push;
+	Summary pull;
+	Summary end_to_end;
+};
+
+template<typename Q>
+requires crlib::is_queue<Q, uint64_t>
+static Result run_scenario(const std::string& name, Scenario scenario, int items_per_producer) {
+	Q queue;
+	std::atomic_bool go(false);
+	std::atomic<uint64_t> consumed(0);
+	std::atomic<uint64_t> empty_pulls(0);
+	uint64_t total = static_cast<uint64_t>(scenario.producers) * items_per_producer;
+
+	// One histogram per thread, merged at the end, so that recording is never contended
+	std::vector<std::unique_ptr<crlib::LatencyHistogram>> push_histograms;
+	std::vector<std::unique_ptr<crlib::LatencyHistogram>> pull_histograms;
+	std::vector<std::unique_ptr<crlib::LatencyHistogram>> queue_histograms;
+	std::vector<std::thread> threads;
+
+	for (int p = 0; p < scenario.producers; p++) {
+		auto h = push_histograms.emplace_back(std::make_unique<crlib::LatencyHistogram>()).get();
+		threads.emplace_back([&queue, &go, h, scenario, items_per_producer]() {
+			while (!go.load(std::memory_order_acquire)) {
+				std::this_thread::yield();
+			}
+			for (int i = 0; i < items_per_producer; i++) {
+				if (scenario.burst > 0 && i > 0 && i % scenario.burst == 0) {
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+				}
+				auto start = now_ns();
+				queue.push(start);
+				h->record(now_ns() - start);
+			}
+		});
+	}
+
+	for (int c = 0; c < scenario.consumers; c++) {
+		auto pull_h = pull_histograms.emplace_back(std::make_unique<crlib::LatencyHistogram>()).get();
+		auto queue_h = queue_histograms.emplace_back(std::make_unique<crlib::LatencyHistogram>()).get();
+		threads.emplace_back([&queue, &go, &consumed, &empty_pulls, pull_h, queue_h, total]() {
+			while (!go.load(std::memory_order_acquire)) {
+				std::this_thread::yield();
+			}
+			uint64_t empty = 0;
+			while (consumed.load(std::memory_order_relaxed) < total) {
+				auto start = now_ns();
+				auto item = queue.pull();
+				auto end = now_ns();
+				if (item.has_value()) {
+					pull_h->record(end - start);
+					queue_h->record(end - std::min(end, item.value()));
+					consumed.fetch_add(1, std::memory_order_relaxed);
+				} else {
+					empty++;
+					std::this_thread::yield();
+				}
+			}
+			empty_pulls.fetch_add(empty, std::memory_order_relaxed);
+		});
+	}
+
+	auto start = Clock::now();
+	go.store(true, std::memory_order_release);
+	for (auto& t : threads) {
+		t.join();
+	}
+	auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	crlib::LatencyHistogram push, pull, in_queue;
+	for (auto& h : push_histograms) {
+		push.merge(*h);
+	}
+	for (auto& h : pull_histograms) {
+		pull.merge(*h);
+	}
+	for (auto& h : queue_histograms) {
+		in_queue.merge(*h);
+	}
+
+	return {name, scenario, total, seconds, empty_pulls.load(), Summary(push), Summary(pull), Summary(in_queue)};
+}
+
+template<typename Q>
+requires crlib::is_queue<Q, uint64_t>
+static void run_queue(const std::string& name, const std::vector<Scenario>& scenarios, int items_per_producer, std::vector<Result>& results) {
+	for (auto& s : scenarios) {
+		auto& r = results.emplace_back(run_scenario<Q>(name, s, items_per_producer));
+		std::cout << std::left << std::setw(16) << r.queue << std::right
+			<< std::setw(3) << s.producers << "P:" << std::setw(2) << s.consumers << "C "
+			<< (s.burst > 0 ? "burst " : "steady") << std::fixed << std::setprecision(2)
+			<< std::setw(9) << static_cast<double>(r.items) * 2 / r.seconds / 1e6 << " Mops/s"
+			<< "  push p50/p99/p99.9 " << r.push.p50 << "/" << r.push.p99 << "/" << r.push.p999 << "ns"
+			<< "  pull p50/p99/p99.9 " << r.pull.p50 << "/" << r.pull.p99 << "/" << r.pull.p999 << "ns"
+			<< "  in queue p50/p99 " << r.end_to_end.p50 << "/" << r.end_to_end.p99 << "ns"
+			<< "  empty pulls " << r.empty_pulls << std::endl;
+	}
+}
+
+static void write_summary(std::ostream& out, const char* name, const Summary& s) {
+	out << "\"" << name << "\":{\"count\":" << s.count << ",\"min\":" << s.min << ",\"mean\":" << s.mean << ",\"p50\":" << s.p50
+		<< ",\"p90\":" << s.p90 << ",\"p99\":" << s.p99 << ",\"p999\":" << s.p999 << ",\"max\":" << s.max << "}";
+}
+
+static void write_json(std::ostream& out, const std::vector<Result>& results, int items_per_producer) {
+	out << "{\"unit\":\"ns\",\"items_per_producer\":" << items_per_producer << ",\"results\":[";
+	for (size_t i = 0; i < results.size(); i++) {
+		auto& r = results[i];
+		out << (i > 0 ? "," : "") << "{\"queue\":\"" << r.queue << "\",\"producers\":" << r.scenario.producers
+			<< ",\"consumers\":" << r.scenario.consumers << ",\"burst\":" << r.scenario.burst << ",\"items\":" << r.items
+			<< ",\"seconds\":" << r.seconds << ",\"ops_per_second\":" << static_cast<double>(r.items) * 2 / r.seconds
+			<< ",\"empty_pulls\":" << r.empty_pulls << ",";
+		write_summary(out, "push", r.push);
+		out << ",";
+		write_summary(out, "pull", r.pull);
+		out << ",";
+		write_summary(out, "in_queue", r.end_to_end);
+		out << "}";
+	}
+	out << "]}" << std::endl;
+}
+
+int main(int argc, char** argv) {
+	int items_per_producer = 100000;
+	std::string json_path;
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--items" && i + 1 < argc) {
+			items_per_producer = std::stoi(argv[++i]);
+		} else if (arg == "--json" && i + 1 < argc) {
+			json_path = argv[++i];
+		} else {
+			std::cerr << "Usage: " << argv[0] << " [--items <per producer>] [--json <path>]" << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<Scenario> scenarios;
+	for (int burst : {0, 64}) {
+		for (auto ratio : std::vector<std::pair<int, int>>{{1, 1}, {1, 4}, {4, 1}, {4, 4}, {8, 8}}) {
+			scenarios.push_back({ratio.first, ratio.second, burst});
+		}
+	}
+
+	// Every queue satisfying crlib::is_queue
+	std::vector<Result> results;
+	run_queue<crlib::BoundlessQueue<uint64_t>>("BoundlessQueue", scenarios, items_per_producer, results);
+	run_queue<crlib::SyncQueue<uint64_t>>("SyncQueue", scenarios, items_per_producer, results);
+
+	if (!json_path.empty()) {
+		std::ofstream out(json_path);
+		write_json(out, results, items_per_producer);
+		if (!out) {
+			std::cerr << "Could not write " << json_path << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}